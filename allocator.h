@@ -0,0 +1,124 @@
+// Free space of the file system, kept as a list of extents sorted by position.
+// Shared by the sketch and the host fragmentation benchmark.
+struct extent {
+    int position;
+    int length;
+};
+
+// A file system of n files has at most n + 1 free extents, the sketch
+// defines a larger limit when it keeps more files
+#ifndef MAX_EXTENTS
+#define MAX_EXTENTS 11
+#endif
+
+struct extentList {
+    extent extents[MAX_EXTENTS];
+    int count;
+};
+
+// Make the whole range from begin to end free
+void initExtents(extentList& list, int begin, int end) {
+    list.count = 0;
+    if (end > begin) {
+        list.extents[0].position = begin;
+        list.extents[0].length = end - begin;
+        list.count = 1;
+    }
+}
+
+// Remove extent i from the list
+void removeExtent(extentList& list, int i) {
+    for (int j = i; j < list.count - 1; j++) {
+        list.extents[j] = list.extents[j + 1];
+    }
+    list.count--;
+}
+
+// Insert a free extent before index i
+bool insertExtent(extentList& list, int i, int position, int length) {
+    if (list.count >= MAX_EXTENTS) {
+        return false;
+    }
+    for (int j = list.count; j > i; j--) {
+        list.extents[j] = list.extents[j - 1];
+    }
+    list.extents[i].position = position;
+    list.extents[i].length = length;
+    list.count++;
+    return true;
+}
+
+// Mark the range of an existing file as used
+void reserveExtent(extentList& list, int position, int length) {
+    for (int i = 0; i < list.count; i++) {
+        extent& e = list.extents[i];
+        if (position >= e.position && position + length <= e.position + e.length) {
+            int after = e.position + e.length - position - length;
+            e.length = position - e.position;
+            if (after > 0) {
+                insertExtent(list, i + 1, position + length, after);
+            }
+            if (e.length == 0) {
+                removeExtent(list, i);
+            }
+            return;
+        }
+    }
+}
+
+// Function returns the position of the smallest free extent that fits
+// length bytes and marks them as used, or -1 if none fits
+int allocateExtent(extentList& list, int length) {
+    int best = -1;
+    for (int i = 0; i < list.count; i++) {
+        if (list.extents[i].length >= length &&
+            (best == -1 || list.extents[i].length < list.extents[best].length)) {
+            best = i;
+        }
+    }
+    if (best == -1) {
+        return -1;
+    }
+    int position = list.extents[best].position;
+    list.extents[best].position += length;
+    list.extents[best].length -= length;
+    if (list.extents[best].length == 0) {
+        removeExtent(list, best);
+    }
+    return position;
+}
+
+// Mark the range of an erased file as free, merging it with its neighbours
+void releaseExtent(extentList& list, int position, int length) {
+    if (length <= 0) {
+        return;
+    }
+    int i = 0;
+    while (i < list.count && list.extents[i].position < position) {
+        i++;
+    }
+    bool mergePrevious = i > 0 && list.extents[i - 1].position + list.extents[i - 1].length == position;
+    bool mergeNext = i < list.count && position + length == list.extents[i].position;
+    if (mergePrevious && mergeNext) {
+        list.extents[i - 1].length += length + list.extents[i].length;
+        removeExtent(list, i);
+    } else if (mergePrevious) {
+        list.extents[i - 1].length += length;
+    } else if (mergeNext) {
+        list.extents[i].position = position;
+        list.extents[i].length += length;
+    } else {
+        insertExtent(list, i, position, length);
+    }
+}
+
+// Function returns the length of the largest free extent
+int largestExtent(const extentList& list) {
+    int largest = 0;
+    for (int i = 0; i < list.count; i++) {
+        if (list.extents[i].length > largest) {
+            largest = list.extents[i].length;
+        }
+    }
+    return largest;
+}
@@ -4,41 +4,107 @@
  *
  * Converts a text file in bytecode-language into a binary file and uploads
  * this to an Arduino running ArduinOS using the "erase" and "store" commands.
+ * Alternatively, converts one or more files into a complete EEPROM image,
+ * FAT included, that can be flashed in one go, e.g. with
+ * avrdude -p m328p -c <programmer> -U eeprom:w:<image>:r
  *
- * Usage: convert <file> <serial port>
+ * Usage: convert [-z] <file> <serial port>
+ *        convert [-z] -i <image> <file|directory> [<file|directory> ...]
+ *        convert [-z] -o <directory> <file|directory> [<file|directory> ...]
+ *        convert [-z] -c <header> <file|directory> [<file|directory> ...]
+ *
+ * With -o, every program is converted into a binary file with the same name
+ * in the given directory. Directories are converted as a whole, in
+ * alphabetical order.
+ *
+ * With -c, the programs become ROM files: a C header (romfiles.h next to
+ * main.cpp) with the programs as one array in flash and their FAT entries.
+ * ArduinOS lists them with the stored files and runs them from flash.
+ *
+ * Integers with an L suffix, or too large for 16 bits, become 32-bit LONG
+ * literals. Numbers with a q suffix, e.g. 1.5q, become Q16.16 FIXED literals.
+ *
+ * String literals go into a constant pool behind the code, every distinct
+ * string once, and are replaced by STRINGREF with the offset of the string in
+ * the file and its size. The pool consists of STRING instructions, so tools
+ * that walk the instructions skip it; the program never reaches it because
+ * it ends with STOP.
+ *
+ * IF, ELSE and WHILE lengths count every IF, ELSE and WHILE inside the block
+ * as a narrow one. Branches longer than 255 bytes are encoded as WIDEIF,
+ * WIDEELSE and WIDEWHILE, with 16-bit lengths, and the converter adds their
+ * extra byte per length to the lengths of the enclosing blocks itself.
+ *
+ * With -z, programs are compressed: up to 16 frequent sequences of
+ * instructions are moved into a dictionary in front of the code and replaced
+ * by one-byte MACRO opcodes, which ArduinOS expands while fetching. Branches
+ * never end up in a macro, and their lengths are recalculated. A program is
+ * only compressed if it becomes smaller.
  *
  * Compilation with gcc or clang on Windows, Linux or MacOS:
  * gcc -o convert convert.c
  */
 #define BUFSIZE 25
-#define PROGSIZE 255
+#define TOKENSIZE 128
+#define PROGSIZE 1024
+#define HASHSIZE 1024  // power of two, large enough to find a perfect hash
 #define C_CHAR 1
 #define C_INT 2
 #define C_STRING 3
 #define C_FLOAT 4
+#define C_DELAYUNTIL 44
+#define C_LONG 60
+#define C_FIXED 62
+#define C_STRINGREF 64
+#define C_WAITEVENT 67
 #define C_IF 128
 #define C_ELSE 129
 #define C_WHILE 131
+#define C_LOOP 133
+#define C_WIDEIF 138
+#define C_WIDEELSE 139
+#define C_WIDEWHILE 140
+#define C_DICTIONARY 223
+#define C_MACRO 224
+#define MAX_MACROS 16
+#define MAX_MACRO_UNITS 6  // instructions in a macro
+#define MAX_MACRO_SIZE 24  // bytes in a macro
+#define MAX_DICTIONARY 255  // macro offsets are single bytes
+
+// EEPROM layout of ArduinOS, see readFAT() and commitFATEntry()
+#define EEPROM_SIZE 1024
+#define MAX_FILES 10
+#define NAME_LENGTH 12
+#define FAT_ENTRY_SIZE 16  // name, beginPosition and length (AVR int = 2 bytes)
+#define FAT_MAGIC 0x4246   // header in front of the FAT slots
+#define SYSTEM_MEMORY (2 + MAX_FILES * FAT_ENTRY_SIZE)
+#define JOURNAL_SIZE 48    // 2 records: FAT entry, from, check, slot, seq and progress
+#define JOURNAL_SLOT(i) (EEPROM_SIZE - JOURNAL_SIZE + (i) * 24 + 19)
+#define FILE_SPACE_END (EEPROM_SIZE - JOURNAL_SIZE)
+#define ROM_SIZE 8192      // flash from ROM_BASE up to 32 KiB
 
+#include <ctype.h>
+#include <dirent.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include "instruction_array.h"
 
-// #ifdef _WIN32
+#ifdef _WIN32
 #include <windows.h>
 #define BPS 9600
 
 // Read characters from serial stream pointed to by h until timeout
-// Copy characters into buffer
+// Copy at most BUFSIZE - 1 characters into buffer
 // Append a terminating zero
 // Return number of characters read
 int readAll(HANDLE h, char *buffer) {
     DWORD bytesRead = 0;
     do {
-        ReadFile(h, buffer, BUFSIZE, &bytesRead, NULL);
+        ReadFile(h, buffer, BUFSIZE - 1, &bytesRead, NULL);
     } while (!bytesRead);
     buffer[bytesRead] = '\0';
     return (int)bytesRead;
@@ -63,70 +129,147 @@ int writeLine(HANDLE h, char *buffer) {
     strcat(buffer, "\n");
     return writeBuffer(h, buffer, strlen(buffer));
 }
-// #else  // Linux and MacOS
-// #include <fcntl.h>
-// #include <sys/ioctl.h>
-// #include <termios.h>
-// #define BPS B9600
-
-// // Read all available characters from serial stream pointed to by h
-// // Copy characters into buf
-// // Append a terminating zero
-// // Return number of characters read
-// ssize_t readAll(int h, char *buf) {
-//     int bytesAvailable;
-//     ioctl(h, FIONREAD, &bytesAvailable);
-//     ssize_t bytesRead = 0, n;
-//     while (bytesRead < bytesAvailable) {
-//         n = read(h, buf, bytesAvailable - bytesRead);
-//         bytesRead += n;
-//         buf += n;
-//     }
-//     *buf = '\0';
-//     return bytesRead;
-// }
-
-// // Write buffer to serial stream pointed to by h
-// // Return number of characters written
-// ssize_t writeBuffer(int h, unsigned char *buffer, int noOfBytes) {
-//     return write(h, buffer, noOfBytes);
-// }
-
-// // Append a newline character to buffer
-// // Write to serial stream pointed to by h
-// // Return number of characters written
-// ssize_t writeLine(int h, char *buffer) {
-//     strcat(buffer, "\n");
-//     return write(h, buffer, strlen(buffer));
-// }
-// #endif
+#else  // Linux and MacOS
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#define BPS B9600
+
+// Read all available characters from serial stream pointed to by h
+// Copy at most BUFSIZE - 1 characters into buf
+// Append a terminating zero
+// Return number of characters read
+ssize_t readAll(int h, char *buf) {
+    int bytesAvailable;
+    ioctl(h, FIONREAD, &bytesAvailable);
+    if (bytesAvailable > BUFSIZE - 1) bytesAvailable = BUFSIZE - 1;
+    ssize_t bytesRead = 0, n;
+    while (bytesRead < bytesAvailable) {
+        n = read(h, buf, bytesAvailable - bytesRead);
+        if (n <= 0) break;
+        bytesRead += n;
+        buf += n;
+    }
+    *buf = '\0';
+    return bytesRead;
+}
+
+// Write buffer to serial stream pointed to by h
+// Return number of characters written
+ssize_t writeBuffer(int h, char *buffer, int noOfBytes) {
+    return write(h, buffer, noOfBytes);
+}
+
+// Append a newline character to buffer
+// Write to serial stream pointed to by h
+// Return number of characters written
+ssize_t writeLine(int h, char *buffer) {
+    strcat(buffer, "\n");
+    return write(h, buffer, strlen(buffer));
+}
+#endif
 
 // Return true if character is space, tab, carriage return or newline
 int isWhiteSpace(char c) {
     return c == ' ' || c == '\t' || c == '\n' || c == '\r';
 }
 
-// Read a single word or multiple words within quotes from file into buf
-// Return EOF if file has ended; otherwise 0
-// Note: cannot deal with escaped or unbalanced quote marks
-int readToken(FILE *file, char *buf) {
+// Source file, read into memory in one block
+typedef struct {
+    char *data;
+    char *pos;
+    char *end;
+    int line;
+} source;
+
+// Read the whole file fileName into src
+// Return 0 on success, -1 if the file cannot be read
+int readSource(const char *fileName, source *src) {
+    FILE *file = fopen(fileName, "rb");
+    if (!file) return -1;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    src->data = malloc(size + 1);
+    if (size < 0 || !src->data ||
+        fread(src->data, 1, size, file) != (size_t)size) {
+        free(src->data);
+        fclose(file);
+        return -1;
+    }
+    fclose(file);
+    src->pos = src->data;
+    src->end = src->data + size;
+    src->line = 1;
+    return 0;
+}
+
+#define TOKEN_TOO_LONG 1
+
+// Read a single word or multiple words within quotes from src into buf
+// Return EOF if file has ended, TOKEN_TOO_LONG if the token does not fit in
+// TOKENSIZE characters; otherwise 0
+// Note: cannot deal with unbalanced quote marks
+int readToken(source *src, char *buf) {
     // skip leading whitespace
-    do {
-        *buf = fgetc(file);
-        if (*buf == EOF) return EOF;
-    } while (isWhiteSpace(*buf));
+    while (src->pos < src->end && isWhiteSpace(*src->pos)) {
+        if (*src->pos == '\n') src->line++;
+        src->pos++;
+    }
+    if (src->pos == src->end) return EOF;
     // start reading token
     char inQuote = 0;
-    if (*buf == '\"') inQuote = 1;
-    do {
-        buf++;
-        *buf = fgetc(file);
-        if (*buf == '\"') inQuote = !inQuote;
-    } while (*buf != EOF && (inQuote || !isWhiteSpace(*buf)));
-    *buf = '\0';  // add terminating zero
+    int length = 0;
+    while (src->pos < src->end && (inQuote || !isWhiteSpace(*src->pos))) {
+        if (length >= TOKENSIZE - 2) return TOKEN_TOO_LONG;
+        if (*src->pos == '\"') {
+            inQuote = !inQuote;
+        } else if (inQuote && *src->pos == '\\' && src->pos + 1 < src->end) {
+            buf[length++] = *src->pos++;  // keep escaped character
+        }
+        buf[length++] = *src->pos++;
+    }
+    buf[length] = '\0';  // add terminating zero
     return 0;
 }
 
+// Perfect hash of the mnemonics in instrSet: slot holds index + 1, 0 if empty
+unsigned char instrHash[HASHSIZE];
+unsigned int hashSeed;
+
+// Return the slot of a mnemonic (case-insensitive) for the given seed
+unsigned int hashName(const char *name, unsigned int seed) {
+    unsigned int h = seed;
+    for (; *name; name++) {
+        h = (h ^ (unsigned char)toupper((unsigned char)*name)) * 16777619u;
+    }
+    return (h ^ (h >> 16)) & (HASHSIZE - 1);
+}
+
+// Generate the perfect hash: search a seed for which no two mnemonics share
+// a slot
+void buildInstrHash(void) {
+    for (hashSeed = 2166136261u;; hashSeed++) {
+        memset(instrHash, 0, sizeof(instrHash));
+        int i;
+        for (i = 0; i < noOfInstr; i++) {
+            unsigned int slot = hashName(instrSet[i].name, hashSeed);
+            if (instrHash[slot]) break;
+            instrHash[slot] = i + 1;
+        }
+        if (i == noOfInstr) return;
+    }
+}
+
+// Return the opcode of a mnemonic, or -1 if it is not an instruction
+int findInstr(const char *name) {
+    int i = instrHash[hashName(name, hashSeed)];
+    if (i && !strcasecmp(name, instrSet[i - 1].name)) {
+        return instrSet[i - 1].number;
+    }
+    return -1;
+}
+
 // Convert the character after the backslash of an escaped character to the
 // character
 char unescape(char c) {
@@ -146,25 +289,468 @@ char unescape(char c) {
     }
 }
 
-int main(int argc, char *argv[]) {
-    // check arguments
-    if (argc != 3) {
-        printf("Usage: %s <file> <serial port>\n", argv[0]);
+// Return the file name without directories, as it is stored in the FAT
+const char *baseName(const char *path) {
+    const char *name = path;
+    for (const char *c = path; *c; c++) {
+        if (*c == '/' || *c == '\\') name = c + 1;
+    }
+    return name;
+}
+
+// Compress programs with a dictionary of macros, set by -z
+int compressing = 0;
+
+// Return the number of operand bytes of the instruction at prog[pc]
+int operandLength(const unsigned char *prog, int pc, int size) {
+    switch (prog[pc]) {
+        case C_CHAR:
+        case 5:  // SET
+        case 6:  // GET
+        case C_IF:
+        case C_ELSE:
+            return 1;
+        case C_INT:
+        case C_WHILE:
+        case C_WIDEIF:
+        case C_WIDEELSE:
+            return 2;
+        case C_STRINGREF:
+            return 3;
+        case C_FLOAT:
+        case C_LONG:
+        case C_FIXED:
+        case C_WIDEWHILE:
+            return 4;
+        case C_STRING: {
+            int length = 1;
+            while (pc + length < size && prog[pc + length]) length++;
+            return length;
+        }
+        default:
+            return 0;
+    }
+}
+
+// Return a 16-bit operand, highbyte first
+int getWord(const unsigned char *c) { return c[0] << 8 | c[1]; }
+
+// Return true if the instruction may be part of a macro: no branches, and
+// nothing that executes itself again (DELAYUNTIL, WAITEVENT, WAITUNTILDONE)
+int isMacroSafe(unsigned char opcode) {
+    if (opcode >= C_IF || opcode == C_DELAYUNTIL || opcode == C_WAITEVENT) return 0;
+    for (int i = 0; i < noOfInstr; i++) {
+        if (instrSet[i].number == opcode) return 1;
+    }
+    return 0;
+}
+
+// Instruction of a program being compressed, or a macro replacing several
+typedef struct {
+    int start;   // offset in the uncompressed program
+    int length;  // bytes in the uncompressed program
+    int macro;   // index of the macro, -1 for an instruction
+} unit;
+
+// Return the number of bytes of units first up to first + count if they can
+// form a macro: plain safe instructions without a jump target inside.
+// Return -1 otherwise.
+int macroBytes(const unsigned char *prog, const unit *units, int noOfUnits,
+               const char *target, int first, int count) {
+    if (first + count > noOfUnits) return -1;
+    int bytes = 0;
+    for (int i = first; i < first + count; i++) {
+        if (units[i].macro != -1 || !isMacroSafe(prog[units[i].start]) ||
+            (i > first && target[units[i].start]))
+            return -1;
+        bytes += units[i].length;
+    }
+    return bytes <= MAX_MACRO_SIZE ? bytes : -1;
+}
+
+// Split the size bytes of prog into units of one instruction
+// Return the number of units, or -1 if the last instruction is truncated
+int splitUnits(const unsigned char *prog, int size, unit *units) {
+    int noOfUnits = 0;
+    for (int pc = 0; pc < size; noOfUnits++) {
+        units[noOfUnits].start = pc;
+        units[noOfUnits].length = 1 + operandLength(prog, pc, size);
+        units[noOfUnits].macro = -1;
+        pc += units[noOfUnits].length;
+        if (pc > size) return -1;  // truncated instruction
+    }
+    return noOfUnits;
+}
+
+// Store the old offsets that the lengths of the branch at prog[p] span in
+// from and to, given its lengths
+// Return the number of lengths, 0 if the instruction is no branch
+int branchSpans(const unsigned char *prog, int p, const int *lengths,
+                int *from, int *to) {
+    int wide = prog[p] >= C_WIDEIF;
+    switch (prog[p]) {
+        case C_IF:
+        case C_ELSE:
+        case C_WIDEIF:
+        case C_WIDEELSE:
+            from[0] = p + 2 + wide;
+            to[0] = from[0] + lengths[0];
+            return 1;
+        case C_WHILE:
+        case C_WIDEWHILE:
+            from[0] = p - lengths[0];
+            to[0] = p;
+            from[1] = p + 3 + 2 * wide;
+            to[1] = from[1] + lengths[1];
+            return 2;
+        default:
+            return 0;
+    }
+}
+
+// Recalculate the branch lengths of prog, which has been rewritten into out
+// with newOffset the new offset of every old one; the rewrites only shrink
+// code, so the lengths still fit
+// Return 0 on success, -1 if a branch spans a part that has no new offset
+int recalculateBranches(const unsigned char *prog, int size, const unit *units,
+                        int noOfUnits, const int *newOffset,
+                        unsigned char *out) {
+    for (int i = 0; i < noOfUnits; i++) {
+        if (units[i].macro != -1) continue;
+        const unsigned char *c = prog + units[i].start;
+        int p = units[i].start;
+        int wide = c[0] >= C_WIDEIF;
+        int lengths[2] = {wide ? getWord(c + 1) : c[1], 0};
+        if (c[0] == C_WHILE || c[0] == C_WIDEWHILE) {
+            lengths[1] = wide ? getWord(c + 3) : c[2];
+        }
+        int from[2], to[2];  // old offsets that each length spans
+        int n = branchSpans(prog, p, lengths, from, to);
+        if (!n) continue;
+        unsigned char *o = out + newOffset[p] + 1;
+        for (int j = 0; j < n; j++) {
+            // Offsets inside a macro have no new offset
+            int newFrom = from[j] >= 0 && from[j] <= size ? newOffset[from[j]] : -1;
+            int newTo = to[j] >= 0 && to[j] <= size ? newOffset[to[j]] : -1;
+            if (newFrom < 0 || newTo < newFrom) {
+                printf("Branch at %d cannot be rewritten\n", p);
+                return -1;
+            }
+            int length = newTo - newFrom;
+            if (wide) {
+                *o++ = length >> 8;
+                *o++ = length & 0xff;
+            } else {
+                *o++ = length;
+            }
+        }
+    }
+    return 0;
+}
+
+// Fill in the branch lengths of prog, given in lengths by offset of the
+// branch and counting every IF, ELSE and WHILE as narrow. Branches longer than
+// 255 bytes become WIDEIF, WIDEELSE and WIDEWHILE, which makes the blocks
+// around them longer, so this repeats until no branch has to be widened.
+// Return the new size, or -1 if a branch does not end on an instruction or
+// the program becomes too large
+int fitBranches(unsigned char *prog, int size, int lengths[][2]) {
+    unit units[PROGSIZE];
+    int noOfUnits = splitUnits(prog, size, units);
+    if (noOfUnits < 0) return size;
+    char widened[PROGSIZE] = {0};  // by unit
+    int newOffset[PROGSIZE + 8];
+    int pc, changed;
+    do {
+        // Lay out the code with the branches widened so far, a wide branch
+        // takes one extra byte per length
+        for (int i = 0; i <= size; i++) newOffset[i] = -1;
+        pc = 0;
+        for (int i = 0; i < noOfUnits; i++) {
+            newOffset[units[i].start] = pc;
+            pc += widened[i] ? 2 * units[i].length - 1 : units[i].length;
+        }
+        newOffset[size] = pc;
+        changed = 0;
+        for (int i = 0; i < noOfUnits; i++) {
+            int p = units[i].start;
+            int from[2], to[2];
+            int n = branchSpans(prog, p, lengths[p], from, to);
+            for (int j = 0; j < n; j++) {
+                int newFrom = from[j] >= 0 && from[j] <= size ? newOffset[from[j]] : -1;
+                int newTo = to[j] >= 0 && to[j] <= size ? newOffset[to[j]] : -1;
+                if (newFrom < 0 || newTo < newFrom) {
+                    printf("Branch at %d does not end on an instruction\n", p);
+                    return -1;
+                }
+                if (newTo - newFrom > 255 && prog[p] < C_WIDEIF && !widened[i]) {
+                    widened[i] = 1;
+                    changed = 1;
+                }
+            }
+        }
+    } while (changed);
+    if (pc > PROGSIZE) {
+        printf("Program with wide branches larger than %d bytes\n", PROGSIZE);
         return -1;
     }
-    // open input file
-    FILE *file = fopen(argv[1], "r");
-    if (!file) {
-        printf("Cannot open file \"%s\"\n", argv[1]);
+
+    unsigned char out[PROGSIZE];
+    for (int i = 0; i < noOfUnits; i++) {
+        int p = units[i].start;
+        unsigned char *o = out + newOffset[p];
+        memcpy(o, prog + p, units[i].length);
+        if (widened[i]) {
+            o[0] = o[0] == C_IF     ? C_WIDEIF
+                   : o[0] == C_ELSE ? C_WIDEELSE
+                                    : C_WIDEWHILE;
+        }
+        int wide = o[0] >= C_WIDEIF;
+        int from[2], to[2];
+        int n = branchSpans(prog, p, lengths[p], from, to);
+        o++;
+        for (int j = 0; j < n; j++) {  // highbyte first
+            int length = newOffset[to[j]] - newOffset[from[j]];
+            if (wide) *o++ = length >> 8;
+            *o++ = length & 0xff;
+        }
+    }
+    memcpy(prog, out, pc);
+    return pc;
+}
+
+// Compress prog in place with a dictionary of macros, see -z
+// Return the new size, which is size if compression does not pay off
+int compress(unsigned char *prog, int size) {
+    unit units[PROGSIZE];
+    int noOfUnits = splitUnits(prog, size, units);
+    if (noOfUnits < 0) return size;
+
+    // Offsets the branches jump to, a macro may start but not continue there
+    char target[PROGSIZE + 8] = {0};
+    for (int i = 0; i < noOfUnits; i++) {
+        const unsigned char *c = prog + units[i].start;
+        int p = units[i].start;
+        int t[2] = {-1, -1};
+        switch (c[0]) {
+            case C_IF:
+            case C_ELSE:
+                t[0] = p + 2 + c[1];
+                break;
+            case C_WIDEIF:
+            case C_WIDEELSE:
+                t[0] = p + 3 + getWord(c + 1);
+                break;
+            case C_WHILE:
+                t[0] = p - c[1];
+                t[1] = p + 4 + c[2];
+                break;
+            case C_WIDEWHILE:
+                t[0] = p - getWord(c + 1);
+                t[1] = p + 6 + getWord(c + 3);
+                break;
+            case C_LOOP:
+                t[0] = p + 1;
+                break;
+        }
+        for (int j = 0; j < 2; j++) {
+            if (t[j] >= 0 && t[j] <= size) target[t[j]] = 1;
+        }
+    }
+
+    // Greedily take the sequence that saves the most bytes as the next macro
+    unsigned char dictionary[MAX_DICTIONARY];
+    int macroOffset[MAX_MACROS + 1];
+    int noOfMacros = 0;
+    int dictionarySize = 0;
+    while (noOfMacros < MAX_MACROS) {
+        int bestSaving = 0, bestFirst = -1, bestCount = 0, bestBytes = 0;
+        for (int first = 0; first < noOfUnits; first++) {
+            for (int count = 1; count <= MAX_MACRO_UNITS; count++) {
+                int bytes = macroBytes(prog, units, noOfUnits, target, first, count);
+                if (bytes < 0) break;
+                if (bytes < 2) continue;
+                // Count the occurrences that do not overlap
+                int uses = 0;
+                for (int i = first; i < noOfUnits;) {
+                    if (macroBytes(prog, units, noOfUnits, target, i, count) == bytes &&
+                        !memcmp(prog + units[i].start, prog + units[first].start, bytes)) {
+                        uses++;
+                        i += count;
+                    } else {
+                        i++;
+                    }
+                }
+                // Each use saves all but one byte, the dictionary costs the
+                // macro and its offset
+                int saving = uses * (bytes - 1) - bytes - 1;
+                if (saving > bestSaving) {
+                    bestSaving = saving;
+                    bestFirst = first;
+                    bestCount = count;
+                    bestBytes = bytes;
+                }
+            }
+        }
+        if (bestFirst == -1 ||
+            3 + noOfMacros + 1 + dictionarySize + bestBytes > MAX_DICTIONARY)
+            break;
+
+        // Move the sequence into the dictionary and replace its uses
+        unsigned char sequence[MAX_MACRO_SIZE];
+        memcpy(sequence, prog + units[bestFirst].start, bestBytes);
+        memcpy(dictionary + dictionarySize, sequence, bestBytes);
+        macroOffset[noOfMacros] = dictionarySize;
+        dictionarySize += bestBytes;
+        int n = 0;
+        for (int i = 0; i < noOfUnits;) {
+            if (i >= bestFirst &&
+                macroBytes(prog, units, noOfUnits, target, i, bestCount) == bestBytes &&
+                !memcmp(prog + units[i].start, sequence, bestBytes)) {
+                units[n] = units[i];
+                units[n].length = bestBytes;
+                units[n].macro = noOfMacros;
+                i += bestCount;
+            } else {
+                units[n] = units[i++];
+            }
+            n++;
+        }
+        noOfUnits = n;
+        noOfMacros++;
+    }
+    if (noOfMacros == 0) return size;
+
+    // Header, macros and code; offsets are relative to the start of the file
+    unsigned char out[PROGSIZE];
+    int header = 3 + noOfMacros;
+    int pc = 0;
+    out[pc++] = C_DICTIONARY;
+    out[pc++] = noOfMacros;
+    macroOffset[noOfMacros] = dictionarySize;
+    for (int i = 0; i <= noOfMacros; i++) {
+        out[pc++] = header + macroOffset[i];
+    }
+    memcpy(out + pc, dictionary, dictionarySize);
+    pc += dictionarySize;
+    int newOffset[PROGSIZE + 8];
+    for (int i = 0; i <= size; i++) newOffset[i] = -1;
+    for (int i = 0; i < noOfUnits; i++) {
+        newOffset[units[i].start] = pc;
+        if (units[i].macro != -1) {
+            out[pc++] = C_MACRO + units[i].macro;
+        } else {
+            memcpy(out + pc, prog + units[i].start, units[i].length);
+            pc += units[i].length;
+        }
+        if (pc >= size) return size;
+    }
+    newOffset[size] = pc;
+
+    if (recalculateBranches(prog, size, units, noOfUnits, newOffset, out)) {
+        return size;
+    }
+    memcpy(prog, out, pc);
+    printf("Compressed size = %d bytes, %d macros\n", pc, noOfMacros);
+    return pc;
+}
+
+// Return the offset of the string s of size bytes in the constant pool,
+// adding it if it is not there yet
+int internString(unsigned char *pool, int *poolSize, const unsigned char *s,
+                 int size) {
+    for (int p = 0; p < *poolSize; p += strlen((char *)pool + p + 1) + 2) {
+        if (!memcmp(pool + p + 1, s, size)) return p + 1;
+    }
+    pool[*poolSize] = C_STRING;
+    memcpy(pool + *poolSize + 1, s, size);
+    *poolSize += size + 1;
+    return *poolSize - size;
+}
+
+// Replace the STRING literals of prog by STRINGREFs into the constant pool,
+// except those of up to one character, which are not larger inline
+// Return the new size, which is size if a branch cannot be rewritten
+int poolStrings(unsigned char *prog, int size, unsigned char *pool,
+                int *poolSize) {
+    unit units[PROGSIZE];
+    int noOfUnits = splitUnits(prog, size, units);
+    if (noOfUnits < 0) return size;
+    unsigned char out[PROGSIZE];
+    int newOffset[PROGSIZE + 8];
+    for (int i = 0; i <= size; i++) newOffset[i] = -1;
+    int pc = 0;
+    for (int i = 0; i < noOfUnits; i++) {
+        const unsigned char *c = prog + units[i].start;
+        newOffset[units[i].start] = pc;
+        if (c[0] == C_STRING && units[i].length > 3) {
+            int offset = internString(pool, poolSize, c + 1, units[i].length - 1);
+            out[pc++] = C_STRINGREF;
+            out[pc++] = offset >> 8;
+            out[pc++] = offset & 0xff;
+            out[pc++] = units[i].length - 1;
+        } else {
+            memcpy(out + pc, c, units[i].length);
+            pc += units[i].length;
+        }
+    }
+    newOffset[size] = pc;
+    if (recalculateBranches(prog, size, units, noOfUnits, newOffset, out)) {
+        *poolSize = 0;
+        return size;
+    }
+    memcpy(prog, out, pc);
+    return pc;
+}
+
+// Append the constant pool behind the size bytes of (compressed) code in prog
+// and make the STRINGREF offsets relative to the start of the file
+// Return the new size, or -1 if the program becomes too large
+int appendPool(unsigned char *prog, int size, const unsigned char *pool,
+               int poolSize) {
+    if (!poolSize) return size;
+    if (size + poolSize > PROGSIZE) {
+        printf("Program with constant pool larger than %d bytes\n", PROGSIZE);
+        return -1;
+    }
+    // The macros of a compressed program lie in front of the code
+    int pc = (size > 2 && prog[0] == C_DICTIONARY) ? prog[2] : 0;
+    while (pc < size) {
+        if (prog[pc] == C_STRINGREF && pc + 3 < size) {
+            int offset = getWord(prog + pc + 1) + size;
+            prog[pc + 1] = offset >> 8;
+            prog[pc + 2] = offset & 0xff;
+        }
+        pc += 1 + operandLength(prog, pc, size);
+    }
+    memcpy(prog + size, pool, poolSize);
+    printf("Constant pool = %d bytes\n", poolSize);
+    return size + poolSize;
+}
+
+// Convert the bytecode-language file fileName into prog
+// Return the converted size, or -1 on error
+int convert(const char *fileName, unsigned char *prog) {
+    // read input file
+    source src;
+    if (readSource(fileName, &src)) {
+        printf("Cannot open file \"%s\"\n", fileName);
         return -1;
     }
 
     // process instructions
-    printf("Converting file \"%s\"\n", argv[1]);
-    char buf[BUFSIZE];
-    unsigned char prog[PROGSIZE];
+    printf("Converting file \"%s\"\n", fileName);
+    char buf[TOKENSIZE];
+    static int lengths[PROGSIZE][2];  // branch lengths by offset
     int pc = 0;
-    while (readToken(file, buf) != EOF) {
+    int result;
+    while ((result = readToken(&src, buf)) == 0) {
+        if (pc + TOKENSIZE + 5 > PROGSIZE) {
+            printf("%s:%d: program larger than %d bytes\n", fileName,
+                   src.line, PROGSIZE);
+            free(src.data);
+            return -1;
+        }
         int command = 0;
         if (*buf == '\'') {  // char
             prog[pc++] = C_CHAR;
@@ -175,7 +761,14 @@ int main(int argc, char *argv[]) {
             }
         } else if ((*buf >= '0' && *buf <= '9') || *buf == '.' ||
                    *buf == '-') {    // number
-            if (strchr(buf, '.')) {  // float
+            if (buf[strlen(buf) - 1] == 'q') {  // fixed, Q16.16
+                double v = strtod(buf, NULL) * 65536;
+                unsigned long f = (long)(v < 0 ? v - 0.5 : v + 0.5);
+                prog[pc++] = C_FIXED;
+                for (int i = 24; i >= 0; i -= 8) {  // highbyte first
+                    prog[pc++] = (f >> i) & 0xff;
+                }
+            } else if (strchr(buf, '.')) {  // float
                 prog[pc++] = C_FLOAT;
 #if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
                 float *f = (float *)(prog + pc);
@@ -190,6 +783,14 @@ int main(int argc, char *argv[]) {
 #endif
             } else if (!strncmp(buf, "0x", 2)) {  // byte as hex
                 prog[pc++] = strtol(buf, NULL, 16);
+            } else if (buf[strlen(buf) - 1] == 'L' ||
+                       strtol(buf, NULL, 10) != (short)strtol(buf, NULL, 10)) {
+                // long, with an L suffix or too large for an int
+                unsigned long l = strtol(buf, NULL, 10);
+                prog[pc++] = C_LONG;
+                for (int i = 24; i >= 0; i -= 8) {  // highbyte first
+                    prog[pc++] = (l >> i) & 0xff;
+                }
             } else {  // int
                 prog[pc++] = C_INT;
 #if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
@@ -215,40 +816,65 @@ int main(int argc, char *argv[]) {
             }
             prog[pc++] = '\0';  // terminating zero
         } else {                // command
-            for (int i = 0; i < noOfInstr; i++) {
-                if (!strcasecmp(buf, instrSet[i].name)) {
-                    prog[pc++] = instrSet[i].number;
-                    command = 1;
-                    break;
-                }
+            int number = findInstr(buf);
+            if (number != -1) {
+                prog[pc++] = number;
+                command = 1;
             }
             if (command) {
-                if (prog[pc - 1] == C_IF || prog[pc - 1] == C_ELSE ||
-                    prog[pc - 1] == C_WHILE) {
-                    readToken(file, buf);  // extra argument
-                    prog[pc++] = atoi(buf);
-                    if (prog[pc - 2] == C_WHILE) {
-                        readToken(file, buf);  // another extra argument
-                        prog[pc++] = atoi(buf);
+                unsigned char op = prog[pc - 1];
+                if (op == C_IF || op == C_ELSE || op == C_WHILE ||
+                    op == C_WIDEIF || op == C_WIDEELSE || op == C_WIDEWHILE) {
+                    // one or two length arguments, filled in by fitBranches
+                    int n = (op == C_WHILE || op == C_WIDEWHILE) ? 2 : 1;
+                    int wide = op >= C_WIDEIF;
+                    for (int i = 0; i < n; i++) {
+                        if (readToken(&src, buf)) {
+                            printf("%s:%d: missing length\n", fileName,
+                                   src.line);
+                            free(src.data);
+                            return -1;
+                        }
+                        lengths[pc - 1][i] = atoi(buf);
                     }
+                    pc += n * (1 + wide);
                 }
             } else {  // variable name
                 prog[pc++] = *buf;
             }
         }
     }
-    fclose(file);
+    free(src.data);
+    if (result == TOKEN_TOO_LONG) {
+        printf("%s:%d: token longer than %d characters\n", fileName, src.line,
+               TOKENSIZE - 1);
+        return -1;
+    }
+    pc = fitBranches(prog, pc, lengths);
+    if (pc < 0) return -1;
     printf("Converted size = %d bytes\n", pc);
+    unsigned char pool[PROGSIZE];
+    int poolSize = 0;
+    pc = poolStrings(prog, pc, pool, &poolSize);
+    if (compressing) pc = compress(prog, pc);
+    return appendPool(prog, pc, pool, poolSize);
+}
 
+// Upload a converted program to the Arduino on serial port portName
+// Return 0 on success, -1 if the port cannot be opened
+int upload(const char *fileName, const char *portName, unsigned char *prog,
+           int pc) {
+    char buf[BUFSIZE];
+    fileName = baseName(fileName);
     // check serial port
 #ifdef _WIN32
-    HANDLE h = CreateFile(argv[2], GENERIC_READ, 0, 0, OPEN_EXISTING, 0, 0);
+    HANDLE h = CreateFile(portName, GENERIC_READ, 0, 0, OPEN_EXISTING, 0, 0);
     if (h == INVALID_HANDLE_VALUE) {
 #else  // Linux and MacOS
-    int h = open(argv[2], O_RDONLY | O_NONBLOCK);
+    int h = open(portName, O_RDONLY | O_NONBLOCK);
     if (h == -1) {
 #endif
-        printf("Cannot open port \"%s\".\n", argv[2]);
+        printf("Cannot open port \"%s\".\n", portName);
         return -1;
     }
 #ifdef _WIN32
@@ -256,11 +882,11 @@ int main(int argc, char *argv[]) {
 #else  // Linux and MacOS
     close(h);
 #endif
-    printf("Opening %s\n", argv[2]);
+    printf("Opening %s\n", portName);
 
     // connect to Arduino
 #ifdef _WIN32
-    h = CreateFile(argv[2], GENERIC_READ | GENERIC_WRITE, 0, 0, OPEN_EXISTING,
+    h = CreateFile(portName, GENERIC_READ | GENERIC_WRITE, 0, 0, OPEN_EXISTING,
                    0, 0);
     DCB dcbSerialParams = {0};
     dcbSerialParams.DCBlength = sizeof(dcbSerialParams);
@@ -277,9 +903,10 @@ int main(int argc, char *argv[]) {
     sleep(1);
     EscapeCommFunction(h, CLRDTR);
 #else  // Linux and MacOS
-    h = open(argv[2], O_RDWR | O_NONBLOCK);
+    h = open(portName, O_RDWR | O_NONBLOCK);
     struct termios settings;
     tcgetattr(h, &settings);
+    cfmakeraw(&settings);  // send program bytes unaltered
     cfsetispeed(&settings, BPS);
     cfsetospeed(&settings, BPS);
     settings.c_cflag |= CLOCAL;  // ignore modem status lines
@@ -288,19 +915,19 @@ int main(int argc, char *argv[]) {
     sleep(2);         // wait for prompt
     readAll(h, buf);  // read prompt
     printf("Response: %s\n", buf);
-    printf("Erasing file \"%s\"\n", argv[1]);
-    snprintf(buf, BUFSIZE, "erase %s", argv[1]);
+    printf("Erasing file \"%s\"\n", fileName);
+    snprintf(buf, BUFSIZE, "erase %s", fileName);
     writeLine(h, buf);
     sleep(1);
     readAll(h, buf);  // read answer
     printf("Response: %s\n", buf);
-    printf("Sending file \"%s\"\n", argv[1]);
-    snprintf(buf, BUFSIZE, "store %s %d", argv[1], pc);
+    printf("Sending file \"%s\"\n", fileName);
+    snprintf(buf, BUFSIZE, "store %s %d", fileName, pc);
     writeLine(h, buf);
     sleep(5);
     readAll(h, buf);  // read answer
     printf("Response: %s\n", buf);
-    writeBuffer(h, prog, pc);  // write data
+    writeBuffer(h, (char *)prog, pc);  // write data
     sleep(5);
     readAll(h, buf);  // read answer
 #ifdef _WIN32
@@ -308,5 +935,235 @@ int main(int argc, char *argv[]) {
 #else  // Linux and MacOS
     close(h);
 #endif
+    return 0;
+}
+
+// Store a 16-bit int in the EEPROM image the way the AVR does (lowbyte first)
+void putInt(unsigned char *image, int address, int value) {
+    image[address] = value & 0xff;
+    image[address + 1] = (value >> 8) & 0xff;
+}
+
+// Convert files into a complete EEPROM image, laid out the way the files
+// would have been stored one by one by writeFAT() and storeFile()
+// Return 0 on success, -1 on error
+int writeImage(const char *imageName, char *fileNames[], int noOfFiles) {
+    if (noOfFiles > MAX_FILES) {
+        printf("Too many files, at most %d fit in the FAT\n", MAX_FILES);
+        return -1;
+    }
+    unsigned char image[EEPROM_SIZE] = {0};
+    unsigned char prog[PROGSIZE];
+    int position = SYSTEM_MEMORY;
+    for (int i = 0; i < noOfFiles; i++) {
+        const char *name = baseName(fileNames[i]);
+        if (strlen(name) >= NAME_LENGTH) {
+            printf("File name \"%s\" is longer than %d characters\n", name,
+                   NAME_LENGTH - 1);
+            return -1;
+        }
+        for (int j = 0; j < i; j++) {
+            if (!strncmp((char *)image + 2 + j * FAT_ENTRY_SIZE, name,
+                         NAME_LENGTH)) {
+                printf("File name \"%s\" occurs twice\n", name);
+                return -1;
+            }
+        }
+        int size = convert(fileNames[i], prog);
+        if (size < 0) return -1;
+        if (position + size > FILE_SPACE_END) {
+            printf("No space left for file \"%s\"\n", name);
+            return -1;
+        }
+        // FAT entry
+        int entry = 2 + i * FAT_ENTRY_SIZE;
+        strcpy((char *)image + entry, name);
+        putInt(image, entry + NAME_LENGTH, position);
+        putInt(image, entry + NAME_LENGTH + 2, size);
+        // file data
+        memcpy(image + position, prog, size);
+        position += size;
+    }
+    putInt(image, 0, FAT_MAGIC);
+    image[JOURNAL_SLOT(0)] = 0xFF;  // no pending FAT update
+    image[JOURNAL_SLOT(1)] = 0xFF;
+
+    FILE *file = fopen(imageName, "wb");
+    if (!file || fwrite(image, 1, EEPROM_SIZE, file) != EEPROM_SIZE) {
+        printf("Cannot write image \"%s\"\n", imageName);
+        if (file) fclose(file);
+        return -1;
+    }
+    fclose(file);
+    printf("Written image \"%s\": %d files, %d bytes free\n", imageName,
+           noOfFiles, FILE_SPACE_END - position);
+    return 0;
+}
+
+// Convert files into a C header with ROM files for the sketch: romImage holds
+// the programs, romFiles their FAT entries with offsets in romImage
+// Return 0 on success, -1 on error
+int writeRomHeader(const char *headerName, char *fileNames[], int noOfFiles) {
+    if (noOfFiles == 0) {
+        printf("No files to convert\n");
+        return -1;
+    }
+    static unsigned char rom[ROM_SIZE];
+    unsigned char prog[PROGSIZE];
+    int position[noOfFiles];
+    int size[noOfFiles];
+    int romSize = 0;
+    for (int i = 0; i < noOfFiles; i++) {
+        const char *name = baseName(fileNames[i]);
+        if (strlen(name) >= NAME_LENGTH) {
+            printf("File name \"%s\" is longer than %d characters\n", name,
+                   NAME_LENGTH - 1);
+            return -1;
+        }
+        for (int j = 0; j < i; j++) {
+            if (!strcmp(baseName(fileNames[j]), name)) {
+                printf("File name \"%s\" occurs twice\n", name);
+                return -1;
+            }
+        }
+        size[i] = convert(fileNames[i], prog);
+        if (size[i] < 0) return -1;
+        if (romSize + size[i] > ROM_SIZE) {
+            printf("No space left in the ROM for file \"%s\"\n", name);
+            return -1;
+        }
+        memcpy(rom + romSize, prog, size[i]);
+        position[i] = romSize;
+        romSize += size[i];
+    }
+
+    FILE *file = fopen(headerName, "w");
+    if (!file) {
+        printf("Cannot write header \"%s\"\n", headerName);
+        return -1;
+    }
+    fprintf(file, "// ROM files for ArduinOS, generated by \"convert -c\"\n");
+    fprintf(file, "const byte romImage[] PROGMEM = {");
+    for (int i = 0; i < romSize; i++) {
+        fprintf(file, "%s0x%02x,", i % 12 ? " " : "\n    ", rom[i]);
+    }
+    fprintf(file, "\n};\nconst FATEntry romFiles[] PROGMEM = {\n");
+    for (int i = 0; i < noOfFiles; i++) {
+        fprintf(file, "    {\"%s\", %d, %d},\n", baseName(fileNames[i]),
+                position[i], size[i]);
+    }
+    fprintf(file, "};\n");
+    fclose(file);
+    printf("Written header \"%s\": %d files, %d bytes\n", headerName,
+           noOfFiles, romSize);
+    return 0;
 }
 
+// Compare function for sorting file names
+int compareNames(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Expand the given files and directories into a list of files
+// Files in a directory are added in alphabetical order, hidden files skipped
+// Return the list, or NULL on error
+char **collectFiles(char *paths[], int noOfPaths, int *noOfFiles) {
+    int capacity = 16;
+    char **files = malloc(capacity * sizeof(char *));
+    *noOfFiles = 0;
+    for (int i = 0; i < noOfPaths; i++) {
+        struct stat info;
+        if (stat(paths[i], &info)) {
+            printf("Cannot open \"%s\"\n", paths[i]);
+            free(files);
+            return NULL;
+        }
+        int first = *noOfFiles;
+        DIR *dir = S_ISDIR(info.st_mode) ? opendir(paths[i]) : NULL;
+        struct dirent *entry;
+        char path[FILENAME_MAX];
+        do {
+            if (dir) {
+                entry = readdir(dir);
+                if (!entry) break;
+                snprintf(path, sizeof(path), "%s/%s", paths[i],
+                         entry->d_name);
+                if (entry->d_name[0] == '.' || stat(path, &info) ||
+                    !S_ISREG(info.st_mode))
+                    continue;
+            } else {
+                snprintf(path, sizeof(path), "%s", paths[i]);
+            }
+            if (*noOfFiles == capacity) {
+                capacity *= 2;
+                files = realloc(files, capacity * sizeof(char *));
+            }
+            files[(*noOfFiles)++] = strdup(path);
+        } while (dir);
+        if (dir) {
+            closedir(dir);
+            qsort(files + first, *noOfFiles - first, sizeof(char *),
+                  compareNames);
+        }
+    }
+    return files;
+}
+
+// Convert files into binary programs with the same name in directory dirName
+// Return 0 on success, -1 on error
+int writePrograms(const char *dirName, char *fileNames[], int noOfFiles) {
+    unsigned char prog[PROGSIZE];
+    char path[FILENAME_MAX];
+    for (int i = 0; i < noOfFiles; i++) {
+        int size = convert(fileNames[i], prog);
+        if (size < 0) return -1;
+        snprintf(path, sizeof(path), "%s/%s", dirName, baseName(fileNames[i]));
+        FILE *file = fopen(path, "wb");
+        if (!file || fwrite(prog, 1, size, file) != (size_t)size) {
+            printf("Cannot write file \"%s\"\n", path);
+            if (file) fclose(file);
+            return -1;
+        }
+        fclose(file);
+    }
+    printf("Converted %d files\n", noOfFiles);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    buildInstrHash();
+    // check arguments
+    if (argc >= 2 && !strcmp(argv[1], "-z")) {
+        compressing = 1;
+        argv++;
+        argc--;
+    }
+    if (argc >= 4 && (!strcmp(argv[1], "-i") || !strcmp(argv[1], "-o") ||
+                      !strcmp(argv[1], "-c"))) {
+        int noOfFiles;
+        char **fileNames = collectFiles(argv + 3, argc - 3, &noOfFiles);
+        if (!fileNames) return -1;
+        int result;
+        if (!strcmp(argv[1], "-i")) {
+            result = writeImage(argv[2], fileNames, noOfFiles);
+        } else if (!strcmp(argv[1], "-o")) {
+            result = writePrograms(argv[2], fileNames, noOfFiles);
+        } else {
+            result = writeRomHeader(argv[2], fileNames, noOfFiles);
+        }
+        for (int i = 0; i < noOfFiles; i++) free(fileNames[i]);
+        free(fileNames);
+        return result;
+    }
+    if (argc != 3) {
+        printf("Usage: %s [-z] <file> <serial port>\n", argv[0]);
+        printf("       %s [-z] -i <image> <file|directory> ...\n", argv[0]);
+        printf("       %s [-z] -o <directory> <file|directory> ...\n", argv[0]);
+        printf("       %s [-z] -c <header> <file|directory> ...\n", argv[0]);
+        return -1;
+    }
+    unsigned char prog[PROGSIZE];
+    int pc = convert(argv[1], prog);
+    if (pc < 0) return -1;
+    return upload(argv[1], argv[2], prog, pc);
+}
@@ -0,0 +1,384 @@
+/* disassemble
+ *
+ * Decodes binary ArduinOS programs back into bytecode-language and prints
+ * static statistics: how often every opcode occurs, and how the program size
+ * is divided over opcodes, literals, variable names and branch lengths.
+ *
+ * Usage: disassemble [-q] <program> [<program> ...]
+ *        disassemble [-q] -i <image>
+ *
+ * Programs are the binary files written by "convert -o", images the EEPROM
+ * images written by "convert -i". With -q only the statistics are printed.
+ * Programs compressed with "convert -z" are printed as their macros followed
+ * by the code.
+ *
+ * Compilation with gcc or clang on Windows, Linux or MacOS:
+ * gcc -o disassemble disassembler.c
+ */
+#define PROGSIZE 1024
+#define C_CHAR 1
+#define C_INT 2
+#define C_STRING 3
+#define C_FLOAT 4
+#define C_SET 5
+#define C_GET 6
+#define C_LONG 60
+#define C_FIXED 62
+#define C_STRINGREF 64
+#define C_IF 128
+#define C_ELSE 129
+#define C_WHILE 131
+#define C_WIDEIF 138
+#define C_WIDEELSE 139
+#define C_WIDEWHILE 140
+#define C_DICTIONARY 223
+#define C_MACRO 224
+
+// EEPROM layout of ArduinOS, see readFAT() and commitFATEntry()
+#define EEPROM_SIZE 1024
+#define MAX_FILES 10
+#define NAME_LENGTH 12
+#define FAT_ENTRY_SIZE 16  // name, beginPosition and length (AVR int = 2 bytes)
+#define FAT_MAGIC 0x4246   // header in front of the FAT slots
+#define FAT_MAGIC_V1 0x4146  // same slots, single-record journal
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "instruction_array.h"
+
+// Size breakdown of the decoded programs
+typedef struct {
+    long opcodes;
+    long literals;
+    long names;
+    long lengths;
+    long unknown;
+    long dictionary;  // dictionary header of compressed programs
+    long count[256];  // number of occurrences per opcode
+    long bytes[256];  // bytes including operands per opcode
+} statistics;
+
+// Return the mnemonic of an opcode, or NULL if it is unknown
+const char *mnemonic(unsigned char opcode) {
+    for (int i = 0; i < noOfInstr; i++) {
+        if (instrSet[i].number == opcode) return instrSet[i].name;
+    }
+    return NULL;
+}
+
+// Return a 16-bit operand, highbyte first
+int readWord(const unsigned char *c) { return (short)(c[0] << 8 | c[1]); }
+
+// Print a character, escaped the way the converter reads it
+void printEscaped(unsigned char c) {
+    switch (c) {
+        case '\n':
+            printf("\\n");
+            break;
+        case '\r':
+            printf("\\r");
+            break;
+        case '\t':
+            printf("\\t");
+            break;
+        case '\\':
+        case '\"':
+        case '\'':
+            printf("\\%c", c);
+            break;
+        default:
+            putchar(c);
+            break;
+    }
+}
+
+// Decode the instructions of a program from pc up to size, print them unless
+// quiet and add them to the statistics. Opcodes below C_MACRO + macros are
+// macros of a compressed program.
+void disassemble(const unsigned char *prog, int pc, int size, int macros,
+                 int quiet, statistics *stats) {
+    while (pc < size) {
+        unsigned char opcode = prog[pc];
+        const unsigned char *op = prog + pc + 1;
+        const char *name = mnemonic(opcode);
+        int macro = opcode >= C_MACRO && opcode < C_MACRO + macros;
+        int length = 0;  // operand bytes
+        long *category = &stats->literals;
+        switch (opcode) {
+            case C_CHAR:
+            case C_SET:
+            case C_GET:
+            case C_IF:
+            case C_ELSE:
+                length = 1;
+                break;
+            case C_INT:
+            case C_WHILE:
+            case C_WIDEIF:
+            case C_WIDEELSE:
+                length = 2;
+                break;
+            case C_STRINGREF:
+                length = 3;
+                break;
+            case C_FLOAT:
+            case C_LONG:
+            case C_FIXED:
+            case C_WIDEWHILE:
+                length = 4;
+                break;
+            case C_STRING:
+                while (pc + length + 1 < size && op[length]) length++;
+                length++;  // terminating zero
+                break;
+            default:
+                break;
+        }
+        if (opcode == C_SET || opcode == C_GET) category = &stats->names;
+        if (opcode >= C_IF) category = &stats->lengths;
+        if (pc + 1 + length > size) length = size - pc - 1;  // truncated file
+
+        if (!quiet) {
+            printf("%04d ", pc);
+            for (int i = 0; i < 6; i++) {
+                if (i <= length) {
+                    printf(" %02x", prog[pc + i]);
+                } else {
+                    printf("   ");
+                }
+            }
+            printf("%s  ", length > 5 ? ".." : "  ");
+            if (macro) {
+                printf("MACRO %d", opcode - C_MACRO);
+            } else if (name) {
+                printf("%s", name);
+            } else {
+                printf("??? (%d)", opcode);
+            }
+            switch (opcode) {
+                case C_CHAR:
+                    printf(" '");
+                    printEscaped(op[0]);
+                    printf("'");
+                    break;
+                case C_INT:
+                    printf(" %d", readWord(op));
+                    break;
+                case C_FLOAT: {
+                    unsigned char b[4] = {op[3], op[2], op[1], op[0]};
+                    float f;
+                    memcpy(&f, b, 4);  // little-endian host
+                    printf(" %g", f);
+                    break;
+                }
+                case C_LONG:
+                    printf(" %dL", (int)((unsigned)readWord(op) << 16 |
+                                         (readWord(op + 2) & 0xffff)));
+                    break;
+                case C_FIXED:
+                    printf(" %gq", (int)((unsigned)readWord(op) << 16 |
+                                         (readWord(op + 2) & 0xffff)) / 65536.0);
+                    break;
+                case C_STRING:
+                    printf(" \"");
+                    for (int i = 0; i < length - 1; i++) printEscaped(op[i]);
+                    printf("\"");
+                    break;
+                case C_STRINGREF: {
+                    // The string lies in the constant pool behind the code
+                    int offset = readWord(op) & 0xffff;
+                    printf(" %d \"", offset);
+                    for (int i = 0; i < op[2] - 1 && offset + i < size; i++)
+                        printEscaped(prog[offset + i]);
+                    printf("\"");
+                    break;
+                }
+                case C_SET:
+                case C_GET:
+                    printf(" %c", op[0]);
+                    break;
+                case C_IF:
+                case C_ELSE:
+                    printf(" %d", op[0]);
+                    break;
+                case C_WHILE:
+                    printf(" %d %d", op[0], op[1]);
+                    break;
+                case C_WIDEIF:
+                case C_WIDEELSE:
+                    printf(" %d", readWord(op) & 0xffff);
+                    break;
+                case C_WIDEWHILE:
+                    printf(" %d %d", readWord(op) & 0xffff,
+                           readWord(op + 2) & 0xffff);
+                    break;
+                default:
+                    break;
+            }
+            printf("\n");
+        }
+
+        if (name || macro) {
+            stats->opcodes++;
+            *category += length;
+        } else {
+            stats->unknown += 1 + length;
+        }
+        stats->count[opcode]++;
+        stats->bytes[opcode] += 1 + length;
+        pc += 1 + length;
+    }
+}
+
+// Decode a program, a compressed one starts with a dictionary: C_DICTIONARY,
+// the number of macros, the offsets of the macros and of the code, and the
+// macros themselves
+void disassembleFile(const unsigned char *prog, int size, int quiet,
+                     statistics *stats) {
+    if (size < 3 || prog[0] != C_DICTIONARY) {
+        disassemble(prog, 0, size, 0, quiet, stats);
+        return;
+    }
+    int macros = prog[1];
+    int code = size > 2 + macros ? prog[2 + macros] : size + 1;
+    if (code > size || macros > 16) {
+        printf("Invalid dictionary\n");
+        return;
+    }
+    stats->dictionary += 3 + macros;
+    for (int i = 0; i < macros; i++) {
+        if (!quiet) printf("MACRO %d:\n", i);
+        disassemble(prog, prog[2 + i], prog[3 + i], 0, quiet, stats);
+    }
+    if (!quiet) printf("CODE:\n");
+    disassemble(prog, code, size, macros, quiet, stats);
+}
+
+// Print the opcode histogram and size breakdown
+void printStatistics(statistics *stats) {
+    long total = stats->opcodes + stats->literals + stats->names +
+                 stats->lengths + stats->unknown + stats->dictionary;
+    if (!total) return;
+    printf("\nOpcode histogram:\n");
+    printf("  %-20s %8s %8s\n", "opcode", "count", "bytes");
+    // print in order of decreasing count
+    long printed[256] = {0};
+    for (;;) {
+        int best = -1;
+        for (int i = 0; i < 256; i++) {
+            if (stats->count[i] && !printed[i] &&
+                (best == -1 || stats->count[i] > stats->count[best]))
+                best = i;
+        }
+        if (best == -1) break;
+        printed[best] = 1;
+        const char *name = mnemonic(best);
+        if (best >= C_MACRO && best < C_MACRO + 16 && !name) {
+            printf("  MACRO %-14d", best - C_MACRO);
+        } else if (name) {
+            printf("  %-20s", name);
+        } else {
+            printf("  ??? (%3d)           ", best);
+        }
+        printf(" %8ld %8ld\n", stats->count[best], stats->bytes[best]);
+    }
+    printf("\nSize breakdown:\n");
+    printf("  %-20s %8ld %5.1f%%\n", "opcodes", stats->opcodes,
+           100.0 * stats->opcodes / total);
+    printf("  %-20s %8ld %5.1f%%\n", "literals", stats->literals,
+           100.0 * stats->literals / total);
+    printf("  %-20s %8ld %5.1f%%\n", "variable names", stats->names,
+           100.0 * stats->names / total);
+    printf("  %-20s %8ld %5.1f%%\n", "branch lengths", stats->lengths,
+           100.0 * stats->lengths / total);
+    if (stats->dictionary) {
+        printf("  %-20s %8ld %5.1f%%\n", "dictionary", stats->dictionary,
+               100.0 * stats->dictionary / total);
+    }
+    if (stats->unknown) {
+        printf("  %-20s %8ld %5.1f%%\n", "unknown", stats->unknown,
+               100.0 * stats->unknown / total);
+    }
+    printf("  %-20s %8ld\n", "total", total);
+}
+
+// Read at most maxSize bytes of file fileName into data
+// Return the number of bytes read, or -1 if the file cannot be opened
+int readFile(const char *fileName, unsigned char *data, int maxSize) {
+    FILE *file = fopen(fileName, "rb");
+    if (!file) {
+        printf("Cannot open file \"%s\"\n", fileName);
+        return -1;
+    }
+    int size = fread(data, 1, maxSize, file);
+    fclose(file);
+    return size;
+}
+
+// Return a 16-bit int from the EEPROM image (lowbyte first)
+int getInt(const unsigned char *image, int address) {
+    return (short)(image[address] | image[address + 1] << 8);
+}
+
+int main(int argc, char *argv[]) {
+    int quiet = argc > 1 && !strcmp(argv[1], "-q");
+    int first = 1 + quiet;
+    if (argc <= first ||
+        (!strcmp(argv[first], "-i") && argc != first + 2)) {
+        printf("Usage: %s [-q] <program> [<program> ...]\n", argv[0]);
+        printf("       %s [-q] -i <image>\n", argv[0]);
+        return -1;
+    }
+    statistics stats = {0};
+
+    if (!strcmp(argv[first], "-i")) {
+        unsigned char image[EEPROM_SIZE];
+        if (readFile(argv[first + 1], image, EEPROM_SIZE) != EEPROM_SIZE) {
+            printf("\"%s\" is not an EEPROM image\n", argv[first + 1]);
+            return -1;
+        }
+        // FAT slots with an empty name are free, the older layout starts
+        // with the number of files instead of the header
+        int noOfFiles = getInt(image, 0);
+        if (noOfFiles == FAT_MAGIC || noOfFiles == FAT_MAGIC_V1) {
+            noOfFiles = MAX_FILES;
+        } else if (noOfFiles < 0 || noOfFiles > MAX_FILES) {
+            printf("Invalid FAT in \"%s\"\n", argv[first + 1]);
+            return -1;
+        }
+        int printed = 0;
+        for (int i = 0; i < noOfFiles; i++) {
+            int entry = 2 + i * FAT_ENTRY_SIZE;
+            char name[NAME_LENGTH + 1] = {0};
+            memcpy(name, image + entry, NAME_LENGTH);
+            if (!name[0]) continue;
+            int position = getInt(image, entry + NAME_LENGTH);
+            int size = getInt(image, entry + NAME_LENGTH + 2);
+            if (position < 0 || size < 0 || position + size > EEPROM_SIZE) {
+                printf("Invalid FAT entry \"%s\"\n", name);
+                return -1;
+            }
+            if (!quiet) {
+                printf("%s%s (address %d, %d bytes):\n", printed ? "\n" : "",
+                       name, position, size);
+            }
+            disassembleFile(image + position, size, quiet, &stats);
+            printed++;
+        }
+    } else {
+        unsigned char prog[PROGSIZE];
+        for (int i = first; i < argc; i++) {
+            int size = readFile(argv[i], prog, PROGSIZE);
+            if (size < 0) return -1;
+            if (!quiet) {
+                printf("%s%s (%d bytes):\n", i > first ? "\n" : "", argv[i],
+                       size);
+            }
+            disassembleFile(prog, size, quiet, &stats);
+        }
+    }
+    printStatistics(&stats);
+    return 0;
+}
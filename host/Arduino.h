@@ -0,0 +1,172 @@
+/* Host version of the Arduino core, as far as ArduinOS uses it
+ *
+ * Serial reads from stdin and writes to stdout, time comes from the host
+ * clock and pin operations are printed. Input pins are LOW until the
+ * simulator toggles them, which runs the attached interrupt handler.
+ */
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+#include <ctype.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <unistd.h>
+
+#include <chrono>
+
+typedef uint8_t byte;
+
+#define PROGMEM
+#define F(s) (s)
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define pgm_read_ptr(p) (*(void *const *)(p))
+#define memcpy_P memcpy
+#define strcmp_P strcmp
+
+#define highByte(w) ((uint8_t)((w) >> 8))
+#define lowByte(w) ((uint8_t)((w)&0xff))
+inline uint16_t word(uint8_t h, uint8_t l) { return (h << 8) | l; }
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+#define NOT_AN_INTERRUPT -1
+
+inline const std::chrono::steady_clock::time_point startTime =
+    std::chrono::steady_clock::now();
+
+inline unsigned long micros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now() - startTime)
+        .count();
+}
+// Start value of millis(), which wraps around at 32 bits like on the AVR
+inline unsigned long millisOffset = 0;
+inline unsigned long millis() { return (uint32_t)(micros() / 1000 + millisOffset); }
+inline void delay(unsigned long ms) { usleep(ms * 1000); }
+inline void delayMicroseconds(unsigned int) {}
+
+inline void pinMode(int pin, int mode) {
+    printf("[pinMode %d %d]\n", pin, mode);
+}
+inline void digitalWrite(int pin, int value) {
+    printf("[digitalWrite %d %d]\n", pin, value);
+}
+// Pins 2 and 3 have the external interrupts 0 and 1, like on the Uno
+const int NO_OF_PINS = 20;
+inline int pinLevel[NO_OF_PINS];
+inline void (*interruptHandler[2])();
+inline int interruptMode[2];
+inline int digitalPinToInterrupt(int pin) {
+    return (pin == 2 || pin == 3) ? pin - 2 : NOT_AN_INTERRUPT;
+}
+inline void attachInterrupt(int n, void (*handler)(), int mode) {
+    printf("[attachInterrupt %d %d]\n", n, mode);
+    interruptHandler[n] = handler;
+    interruptMode[n] = mode;
+}
+inline void detachInterrupt(int n) { interruptHandler[n] = NULL; }
+inline void noInterrupts() {}
+inline void interrupts() {}
+// Change the level of an input pin and run its interrupt handler if the mode
+// matches the edge
+inline void toggleInput(int pin) {
+    if (pin < 0 || pin >= NO_OF_PINS) return;
+    pinLevel[pin] = !pinLevel[pin];
+    int n = digitalPinToInterrupt(pin);
+    if (n == NOT_AN_INTERRUPT || !interruptHandler[n]) return;
+    int mode = interruptMode[n];
+    if (mode == CHANGE || (mode == RISING && pinLevel[pin] == HIGH) ||
+        ((mode == FALLING || mode == LOW) && pinLevel[pin] == LOW)) {
+        interruptHandler[n]();
+    }
+}
+inline int digitalRead(int pin) {
+    return (pin >= 0 && pin < NO_OF_PINS) ? pinLevel[pin] : LOW;
+}
+inline int analogRead(int) { return 0; }
+inline void analogWrite(int pin, int value) {
+    printf("[analogWrite %d %d]\n", pin, value);
+}
+
+// Serial port on stdin and stdout
+class HardwareSerial {
+   public:
+    void begin(long) {}
+    int available() {
+        poll();
+        return tail - head;
+    }
+    int read() {
+        poll();
+        return head < tail ? (uint8_t)input[head++] : -1;
+    }
+    // True when stdin has ended and all input has been read
+    bool finished() {
+        poll();
+        return ended && head == tail;
+    }
+
+    void print(const char *s) { fputs(s, stdout); }
+    void print(char c) { putchar(c); }
+    void print(int i) { printf("%d", i); }
+    void print(unsigned int i) { printf("%u", i); }
+    void print(long l) { printf("%ld", l); }
+    void print(unsigned long l) { printf("%lu", l); }
+    void print(double d, int digits = 2) { printf("%.*f", digits, d); }
+    void println() {
+        putchar('\n');
+        fflush(stdout);
+    }
+    template <typename T>
+    void println(T value) {
+        print(value);
+        println();
+    }
+    void println(double d, int digits) {
+        print(d, digits);
+        println();
+    }
+
+   private:
+    char input[4096];
+    int head = 0;
+    int tail = 0;
+    bool ended = false;
+
+    // Move waiting characters from stdin into the input buffer
+    void poll() {
+        if (ended) return;
+        if (head == tail) head = tail = 0;
+        if (tail == (int)sizeof(input)) return;
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(0, &fds);
+        timeval timeout = {0, 0};
+        if (select(1, &fds, NULL, NULL, &timeout) > 0) {
+            ssize_t n = ::read(0, input + tail, sizeof(input) - tail);
+            if (n <= 0) {
+                ended = true;
+            } else {
+                tail += n;
+            }
+        }
+    }
+};
+
+inline HardwareSerial Serial;
+
+#endif
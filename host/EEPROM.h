@@ -0,0 +1,40 @@
+/* Host version of the Arduino EEPROM library: 1 KiB in memory, which the
+ * simulator loads from and saves to an image file. Every cell counts its
+ * writes, so benchmarks can measure the wear.
+ */
+#ifndef EEPROM_H
+#define EEPROM_H
+
+#include <stdint.h>
+#include <string.h>
+
+class EEPROMClass {
+   public:
+    uint8_t data[1024];
+    unsigned long writes[1024];
+
+    uint8_t read(int address) { return data[address]; }
+    void write(int address, uint8_t value) {
+        data[address] = value;
+        writes[address]++;
+    }
+    void update(int address, uint8_t value) {
+        if (data[address] != value) write(address, value);
+    }
+    template <typename T>
+    T &get(int address, T &t) {
+        memcpy(&t, data + address, sizeof(T));
+        return t;
+    }
+    template <typename T>
+    const T &put(int address, const T &t) {
+        const uint8_t *b = (const uint8_t *)&t;
+        for (unsigned int i = 0; i < sizeof(T); i++) update(address + i, b[i]);
+        return t;
+    }
+    int length() { return sizeof(data); }
+};
+
+inline EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,49 @@
+/* Host version of the Sd2Card class of the Arduino SD library: the raw blocks
+ * of the card are kept in an image file, which the simulator opens before
+ * setup(). Blocks beyond the end of the image read as zeros. The reads and
+ * writes of whole blocks are counted, so the effect of the sector cache can
+ * be measured.
+ */
+#ifndef SD_H
+#define SD_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define SPI_FULL_SPEED 0
+#define SPI_HALF_SPEED 1
+#define SPI_QUARTER_SPEED 2
+
+class Sd2Card {
+   public:
+    FILE *file = NULL;
+    unsigned long blockReads = 0;
+    unsigned long blockWrites = 0;
+
+    // Host only: use the image file path as card, it is created if needed
+    bool open(const char *path) {
+        file = fopen(path, "r+b");
+        if (!file) file = fopen(path, "w+b");
+        return file != NULL;
+    }
+    bool init(uint8_t sckRateID, uint8_t chipSelectPin) { return file != NULL; }
+    bool readBlock(uint32_t block, uint8_t *dst) {
+        if (!file) return false;
+        memset(dst, 0, 512);
+        fseek(file, (long)block * 512, SEEK_SET);
+        fread(dst, 1, 512, file);
+        blockReads++;
+        return true;
+    }
+    bool writeBlock(uint32_t block, const uint8_t *src) {
+        if (!file) return false;
+        fseek(file, (long)block * 512, SEEK_SET);
+        if (fwrite(src, 1, 512, file) != 512) return false;
+        fflush(file);
+        blockWrites++;
+        return true;
+    }
+};
+
+#endif
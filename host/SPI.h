@@ -0,0 +1,7 @@
+/* Host version of the Arduino SPI library. The SD card is simulated by SD.h,
+ * so nothing is needed here.
+ */
+#ifndef SPI_H
+#define SPI_H
+
+#endif
@@ -0,0 +1,67 @@
+/* Host version of the AVR watchdog
+ *
+ * The watchdog is an interval timer of the host. When it is not reset in time
+ * SIGALRM calls watchdogExpired, which the program sets to "reset" the board,
+ * otherwise the process ends with exit code WATCHDOG_EXIT. MCUSR keeps the
+ * cause of the last reset like on the AVR.
+ */
+#ifndef AVR_WDT_H
+#define AVR_WDT_H
+
+#include <signal.h>
+#include <stdint.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#ifndef _BV
+#define _BV(bit) (1 << (bit))
+#endif
+
+// Reset flags in MCUSR
+#define PORF 0
+#define EXTRF 1
+#define BORF 2
+#define WDRF 3
+inline volatile uint8_t MCUSR = _BV(PORF);
+
+// Timeouts, the watchdog runs for 16 ms << timeout
+#define WDTO_15MS 0
+#define WDTO_30MS 1
+#define WDTO_60MS 2
+#define WDTO_120MS 3
+#define WDTO_250MS 4
+#define WDTO_500MS 5
+#define WDTO_1S 6
+#define WDTO_2S 7
+#define WDTO_4S 8
+#define WDTO_8S 9
+
+const int WATCHDOG_EXIT = 3;
+// Called from the signal handler when the watchdog expires
+inline void (*watchdogExpired)() = NULL;
+inline long watchdogMicros = 0;
+
+inline void watchdogSignal(int) {
+    const char message[] = "[watchdog reset]\n";
+    ssize_t written = write(1, message, sizeof(message) - 1);
+    (void)written;
+    if (watchdogExpired) watchdogExpired();
+    _exit(WATCHDOG_EXIT);
+}
+inline void wdt_reset() {
+    if (!watchdogMicros) return;
+    itimerval timer = {{0, 0}, {watchdogMicros / 1000000, watchdogMicros % 1000000}};
+    setitimer(ITIMER_REAL, &timer, NULL);
+}
+inline void wdt_enable(uint8_t timeout) {
+    signal(SIGALRM, watchdogSignal);
+    watchdogMicros = 16000L << timeout;
+    wdt_reset();
+}
+inline void wdt_disable() {
+    watchdogMicros = 0;
+    itimerval timer = {};
+    setitimer(ITIMER_REAL, &timer, NULL);
+}
+
+#endif
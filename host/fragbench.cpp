@@ -0,0 +1,112 @@
+/* fragbench
+ *
+ * Measures the fragmentation of the EEPROM file system under random store and
+ * erase workloads. The best-fit allocator of the sketch (allocator.h) is
+ * compared with the first-fit scan it replaced, both on the same sequence of
+ * operations.
+ *
+ * Usage: fragbench [<cycles>] [<seed>]
+ *
+ * Compilation with gcc or clang on Linux or MacOS:
+ * g++ -std=c++17 -o fragbench host/fragbench.cpp
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../allocator.h"
+
+// EEPROM layout of ArduinOS
+const int EEPROM_SIZE = 1024;
+const int MAX_FILES = 10;
+const int SYSTEM_MEMORY = 162;
+const int MIN_FILE_SIZE = 8;
+const int MAX_FILE_SIZE = 200;
+
+// Function takes the free extent with the lowest position that fits
+int firstFit(extentList& list, int length) {
+    for (int i = 0; i < list.count; i++) {
+        if (list.extents[i].length >= length) {
+            int position = list.extents[i].position;
+            reserveExtent(list, position, length);
+            return position;
+        }
+    }
+    return -1;
+}
+
+struct result {
+    long stores;
+    long failures;       // stores that failed although there was enough free space
+    long full;           // stores that failed for lack of free space
+    double fragmentation;  // sum of 1 - largest extent / free space
+    long samples;
+    long extents;        // sum of the number of free extents
+};
+
+void run(long cycles, unsigned seed, bool bestFit, result& r) {
+    srand(seed);
+    extentList list;
+    initExtents(list, SYSTEM_MEMORY, EEPROM_SIZE);
+    int position[MAX_FILES];
+    int length[MAX_FILES];
+    int files = 0;
+    int freeSpace = EEPROM_SIZE - SYSTEM_MEMORY;
+    r = result();
+
+    for (long cycle = 0; cycle < cycles; cycle++) {
+        bool store = files == 0 || (files < MAX_FILES && rand() % 100 < 55);
+        if (store) {
+            int size = MIN_FILE_SIZE + rand() % (MAX_FILE_SIZE - MIN_FILE_SIZE + 1);
+            int p = bestFit ? allocateExtent(list, size) : firstFit(list, size);
+            r.stores++;
+            if (p != -1) {
+                position[files] = p;
+                length[files] = size;
+                files++;
+                freeSpace -= size;
+            } else if (size <= freeSpace) {
+                r.failures++;
+            } else {
+                r.full++;
+            }
+        } else {
+            int i = rand() % files;
+            releaseExtent(list, position[i], length[i]);
+            freeSpace += length[i];
+            position[i] = position[files - 1];
+            length[i] = length[files - 1];
+            files--;
+        }
+        if (freeSpace > 0) {
+            r.fragmentation += 1.0 - (double)largestExtent(list) / freeSpace;
+            r.samples++;
+        }
+        r.extents += list.count;
+    }
+}
+
+void print(const char* name, long cycles, const result& r) {
+    printf("%-10s %10ld %10ld %10ld %13.1f%% %10.2f\n", name, r.stores, r.failures, r.full,
+           100.0 * r.fragmentation / (r.samples ? r.samples : 1), (double)r.extents / cycles);
+}
+
+int main(int argc, char* argv[]) {
+    long cycles = argc > 1 ? atol(argv[1]) : 100000;
+    unsigned seed = argc > 2 ? atoi(argv[2]) : 1;
+    if (cycles <= 0) {
+        printf("Usage: %s [<cycles>] [<seed>]\n", argv[0]);
+        return -1;
+    }
+    result first, best;
+    run(cycles, seed, false, first);
+    run(cycles, seed, true, best);
+    printf("%ld cycles, seed %u, file sizes %d-%d bytes\n\n", cycles, seed, MIN_FILE_SIZE,
+           MAX_FILE_SIZE);
+    printf("%-10s %10s %10s %10s %14s %10s\n", "policy", "stores", "fragmented", "full",
+           "fragmentation", "extents");
+    print("first-fit", cycles, first);
+    print("best-fit", cycles, best);
+    printf("\nfragmented: stores that failed although the free space was large enough\n");
+    printf("fragmentation: average of 1 - largest free extent / free space\n");
+    return 0;
+}
@@ -0,0 +1,160 @@
+/* runaway
+ *
+ * Checks that runaway processes are stopped. Synthetic programs that never
+ * wait are started next to well-behaved ones with an instruction budget, the
+ * runaways have to be suspended and the others have to keep running. Then the
+ * interpreter is hung after boot in a child process: the watchdog has to reset
+ * it, and the boot after the reset has to start the autostart list.
+ *
+ * Usage: runaway
+ * The options -h and -r are used by the program itself.
+ *
+ * Compilation with gcc or clang on Linux or MacOS:
+ * g++ -std=c++17 -I host -o runaway host/runaway.cpp
+ */
+#include <fcntl.h>
+#include <sys/wait.h>
+
+#include "../main.cpp"
+
+const uint16_t BUDGET = 50;
+const unsigned long RUN_MILLIS = 300;
+
+// Programs that never wait
+const byte tight[] = {LOOP, ENDLOOP};
+const byte counter[] = {INT, 0, 0, SET, 'n', LOOP, GET, 'n', INCREMENT, SET, 'n', ENDLOOP};
+// Polls millis() for 2 seconds instead of sleeping in DELAYUNTIL
+const byte busyWait[] = {MILLIS, INT, 0x07, 0xd0, PLUS, SET, 't', MILLIS, GET, 't',
+                         LESSTHAN, WHILE, 4, 0, ENDWHILE, STOP};
+// Programs that wait: a periodic task, and a parent waiting for a runaway child
+const byte periodic[] = {LOOP, MILLIS, INT, 0, 20, PLUS, DELAYUNTIL, ENDLOOP};
+const byte parent[] = {STRING, 't', 'i', 'g', 'h', 't', 0, FORK, WAITUNTILDONE, STOP};
+
+int failures = 0;
+
+void check(bool ok, const char* what) {
+    printf("%s: %s\n", ok ? "PASS" : "FAIL", what);
+    if (!ok) failures++;
+}
+
+process* find(const char* name) {
+    for (int i = 0; i < PROCESS_TABLE_SIZE; i++) {
+        if (processTable[i].state != '0' && !strcmp(processTable[i].name, name)) {
+            return &processTable[i];
+        }
+    }
+    return NULL;
+}
+
+void runFor(unsigned long ms) {
+    unsigned long start = millis();
+    while (millis() - start < ms) {
+        feedWatchdog();
+        runProcesses();
+    }
+}
+
+#if WATCHDOG_ENABLED
+// Every boot after the first runs this program again, with the EEPROM passed
+// in an image file: with -h the interpreter hangs after boot, with -r it has
+// been reset by the watchdog
+const char* imageFile = "/tmp/runaway.eeprom";
+char* self;
+
+void saveImage() {
+    int file = open(imageFile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (file != -1) {
+        ssize_t written = write(file, EEPROM.data, sizeof(EEPROM.data));
+        (void)written;
+        close(file);
+    }
+}
+bool loadImage() {
+    FILE* file = fopen(imageFile, "rb");
+    if (!file) return false;
+    bool ok = fread(EEPROM.data, 1, sizeof(EEPROM.data), file) == sizeof(EEPROM.data);
+    fclose(file);
+    return ok;
+}
+// Called by the watchdog
+void reset() {
+    saveImage();
+    char flag[] = "-r";
+    char* arguments[] = {self, flag, NULL};
+    execv(self, arguments);
+}
+
+int hang() {
+    if (!loadImage()) return 1;
+    watchdogExpired = reset;
+    setup();
+    runFor(10);
+    for (;;) {
+    }
+}
+int afterReset() {
+    if (!loadImage()) return 1;
+    remove(imageFile);
+    MCUSR = _BV(WDRF);
+    setup();
+    wdt_disable();
+    return find("periodic") ? 0 : 1;
+}
+#endif
+
+int main(int argc, char* argv[]) {
+#if WATCHDOG_ENABLED
+    self = argv[0];
+    if (argc > 1 && !strcmp(argv[1], "-h")) {
+        return hang();
+    }
+    if (argc > 1 && !strcmp(argv[1], "-r")) {
+        return afterReset();
+    }
+#endif
+    memset(EEPROM.data, 0, sizeof(EEPROM.data));
+    setup();
+    addFile("tight", sizeof(tight), (const char*)tight);
+    addFile("counter", sizeof(counter), (const char*)counter);
+    addFile("busywait", sizeof(busyWait), (const char*)busyWait);
+    addFile("periodic", sizeof(periodic), (const char*)periodic);
+    addFile("parent", sizeof(parent), (const char*)parent);
+
+    defaultBudget = BUDGET;
+    runProcess("counter", DEFAULT_PRIORITY);
+    runProcess("busywait", DEFAULT_PRIORITY);
+    runProcess("periodic", DEFAULT_PRIORITY);
+    runProcess("parent", DEFAULT_PRIORITY);
+    runFor(RUN_MILLIS);
+
+    process* p = find("tight");
+    check(p && p->state == 'p' && p->instructions == BUDGET + 1u, "tight loop suspended");
+    p = find("counter");
+    check(p && p->state == 'p' && p->instructions == BUDGET + 1u, "counting loop suspended");
+    p = find("busywait");
+    check(p && p->state == 'p', "busy wait on millis() suspended");
+    p = find("periodic");
+    check(p && p->state != 'p' && p->instructions > BUDGET, "periodic task keeps running");
+    p = find("parent");
+    check(p && p->state != 'p' && p->instructions > BUDGET, "waiting parent keeps running");
+
+#if WATCHDOG_ENABLED
+    wdt_disable();
+    setAutostart("periodic", DEFAULT_PRIORITY);
+    saveImage();
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0) {
+        char flag[] = "-h";
+        char* arguments[] = {self, flag, NULL};
+        execv(self, arguments);
+        _exit(1);
+    }
+    int status;
+    waitpid(child, &status, 0);
+    check(WIFEXITED(status) && WEXITSTATUS(status) == 0,
+          "hung interpreter reset by the watchdog into the autostart list");
+#endif
+    printf("%d failures\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,218 @@
+/* simulator
+ *
+ * Runs ArduinOS on the host. CLI input is read from stdin and output is
+ * written to stdout, so sessions can be scripted. The EEPROM can be loaded
+ * from and saved to an image file, e.g. one written by "convert -i".
+ *
+ * Usage: simulator [-e <eeprom image>] [-s <card image>] [-t <ms>] [-m <ms>]
+ *                  [-j <json file>] [-w] [-i <pin>@<ms> ...]
+ *
+ *   -e  load the EEPROM from the image (if it exists) and save it on exit
+ *   -s  use the image as SD card, it is created if it does not exist (needs
+ *       SD_ENABLED)
+ *   -t  keep running for this many milliseconds after stdin has ended
+ *       (default 1000)
+ *   -m  start millis() at this value, e.g. 4294960000 to see it wrap around
+ *       after 7 seconds
+ *   -j  write the profiling counters as JSON on exit (needs
+ *       PROFILING_ENABLED)
+ *   -w  boot as after a reset by the watchdog. When the watchdog expires, the
+ *       EEPROM image is saved and the simulator starts again with -w; input
+ *       that had not been read yet is lost, like on the Arduino.
+ *   -i  toggle an input pin this many milliseconds after the start, which
+ *       runs its interrupt handler on pins 2 and 3; can be repeated
+ *
+ * Compilation with gcc or clang on Linux or MacOS:
+ * g++ -std=c++17 -I host -DPROFILING_ENABLED=1 -o simulator host/simulator.cpp
+ */
+#include <fcntl.h>
+
+#include "../main.cpp"
+
+#if PROFILING_ENABLED
+#include "../instruction_array.h"
+
+// Return the mnemonic of an opcode, or NULL if it is unknown
+const char *mnemonic(byte opcode) {
+    for (int i = 0; i < noOfInstr; i++) {
+        if (instrSet[i].number == opcode) return instrSet[i].name;
+    }
+    return NULL;
+}
+
+// Write the opcode and process counters as JSON
+void writeStats(FILE *file) {
+    fprintf(file, "{\n  \"opcodes\": [");
+    bool first = true;
+    for (int slot = 0; slot < PROFILE_SLOTS; slot++) {
+        if (opcodeCount[slot] == 0) continue;
+        const char *name = mnemonic(slotOpcode(slot));
+        fprintf(file,
+                "%s\n    {\"opcode\": %d, \"name\": \"%s\", \"count\": %lu, "
+                "\"micros\": %lu}",
+                first ? "" : ",", slotOpcode(slot), name ? name : "?",
+                opcodeCount[slot], opcodeMicros[slot]);
+        first = false;
+    }
+    fprintf(file, "\n  ],\n  \"processes\": [");
+    first = true;
+    for (int i = 0; i < PROCESS_TABLE_SIZE; i++) {
+        if (processTable[i].state == '0') continue;
+        fprintf(file,
+                "%s\n    {\"pid\": %d, \"name\": \"%s\", \"state\": \"%c\", "
+                "\"instructions\": %u, \"micros\": %lu}",
+                first ? "" : ",", processTable[i].procID, processTable[i].name,
+                processTable[i].state, processTable[i].instructions,
+                processTable[i].cpuMicros);
+        first = false;
+    }
+    fprintf(file, "\n  ]\n}\n");
+}
+#endif
+
+const char *eepromFile = NULL;
+// Input pin changes of -i
+struct inputChange {
+    int pin;
+    unsigned long ms;
+};
+const int MAX_INPUT_CHANGES = 64;
+inputChange inputChanges[MAX_INPUT_CHANGES];
+int noOfInputChanges = 0;
+
+#if WATCHDOG_ENABLED
+char **restartArguments;
+
+// Reset the board: save the EEPROM and start again, with -w
+void restart() {
+    if (eepromFile) {
+        int file = open(eepromFile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (file != -1) {
+            ssize_t written = write(file, EEPROM.data, sizeof(EEPROM.data));
+            (void)written;
+            close(file);
+        }
+    }
+    execvp(restartArguments[0], restartArguments);
+}
+#endif
+
+int main(int argc, char *argv[]) {
+#if SD_ENABLED
+    const char *cardFile = NULL;
+#endif
+#if PROFILING_ENABLED
+    const char *jsonFile = NULL;
+#endif
+    unsigned long runTime = 1000;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-e") && i + 1 < argc) {
+            eepromFile = argv[++i];
+#if SD_ENABLED
+        } else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+            cardFile = argv[++i];
+#endif
+        } else if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+            runTime = atol(argv[++i]);
+        } else if (!strcmp(argv[i], "-m") && i + 1 < argc) {
+            millisOffset = strtoul(argv[++i], NULL, 10);
+#if PROFILING_ENABLED
+        } else if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+            jsonFile = argv[++i];
+#endif
+        } else if (!strcmp(argv[i], "-i") && i + 1 < argc &&
+                   noOfInputChanges < MAX_INPUT_CHANGES) {
+            inputChange &change = inputChanges[noOfInputChanges++];
+            if (sscanf(argv[++i], "%d@%lu", &change.pin, &change.ms) != 2) {
+                printf("\"%s\" is not <pin>@<ms>\n", argv[i]);
+                return -1;
+            }
+#if WATCHDOG_ENABLED
+        } else if (!strcmp(argv[i], "-w")) {
+            MCUSR = _BV(WDRF);
+#endif
+        } else {
+            printf("Usage: %s [-e <eeprom image>] [-s <card image>] [-t <ms>] "
+                   "[-m <ms>] [-j <json file>] [-w] [-i <pin>@<ms> ...]\n",
+                   argv[0]);
+            return -1;
+        }
+    }
+
+    memset(EEPROM.data, 0, sizeof(EEPROM.data));
+    if (eepromFile) {
+        FILE *file = fopen(eepromFile, "rb");
+        if (file) {
+            if (fread(EEPROM.data, 1, sizeof(EEPROM.data), file) !=
+                sizeof(EEPROM.data)) {
+                printf("\"%s\" is not an EEPROM image\n", eepromFile);
+                fclose(file);
+                return -1;
+            }
+            fclose(file);
+        }
+    }
+
+#if SD_ENABLED
+    if (cardFile && !card.open(cardFile)) {
+        printf("Cannot open \"%s\"\n", cardFile);
+        return -1;
+    }
+#endif
+
+#if WATCHDOG_ENABLED
+    restartArguments = new char *[argc + 2];
+    for (int i = 0; i < argc; i++) {
+        restartArguments[i] = argv[i];
+    }
+    bool restarted = MCUSR & _BV(WDRF);
+    restartArguments[argc] = restarted ? NULL : (char *)"-w";
+    restartArguments[argc + 1] = NULL;
+    watchdogExpired = restart;
+#endif
+
+    setup();
+    unsigned long endTime = 0;
+    for (;;) {
+        loop();
+        for (int i = 0; i < noOfInputChanges; i++) {
+            if (inputChanges[i].pin != -1 && micros() / 1000 >= inputChanges[i].ms) {
+                toggleInput(inputChanges[i].pin);
+                inputChanges[i].pin = -1;
+            }
+        }
+        if (Serial.finished()) {
+            if (!endTime) {
+                endTime = micros() / 1000 + runTime;
+            } else if (micros() / 1000 >= endTime) {
+                break;
+            }
+        }
+    }
+#if WATCHDOG_ENABLED
+    wdt_disable();
+#endif
+    storage.flush();
+
+    if (eepromFile) {
+        FILE *file = fopen(eepromFile, "wb");
+        if (!file) {
+            printf("Cannot write \"%s\"\n", eepromFile);
+            return -1;
+        }
+        fwrite(EEPROM.data, 1, sizeof(EEPROM.data), file);
+        fclose(file);
+    }
+#if PROFILING_ENABLED
+    if (jsonFile) {
+        FILE *file = fopen(jsonFile, "w");
+        if (!file) {
+            printf("Cannot write \"%s\"\n", jsonFile);
+            return -1;
+        }
+        writeStats(file);
+        fclose(file);
+    }
+#endif
+    return 0;
+}
@@ -0,0 +1,113 @@
+/* wearbench
+ *
+ * Measures the EEPROM wear of the file system under a random store and erase
+ * workload. The sketch is compiled twice, once with the FAT and once with the
+ * log-structured layout (LOG_STRUCTURED_ENABLED), and both run the same
+ * sequence of operations. The hottest cell limits the life of the EEPROM,
+ * which is rated for 100,000 writes per cell.
+ *
+ * Usage: wearbench [<cycles>] [<seed>]
+ *
+ * Compilation with gcc or clang on Linux or MacOS:
+ * g++ -std=c++17 -I host -o wearbench host/wearbench.cpp
+ */
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <avr/wdt.h>
+
+namespace fat {
+#define LOG_STRUCTURED_ENABLED 0
+#include "../main.cpp"
+#undef LOG_STRUCTURED_ENABLED
+}  // namespace fat
+
+namespace logfs {
+#define LOG_STRUCTURED_ENABLED 1
+#include "../main.cpp"
+#undef LOG_STRUCTURED_ENABLED
+}  // namespace logfs
+
+const int MIN_FILE_SIZE = 8;
+const int MAX_FILE_SIZE = 200;
+const unsigned long RATED_WRITES = 100000;
+
+struct result {
+    long stores;
+    long full;                  // stores that failed for lack of space
+    long lost;                  // failed stores that freeBytes() said would fit
+    unsigned long total;        // writes to all cells
+    unsigned long hottest;      // writes to the most written cell
+    int hottestCell;
+    unsigned long metadata;     // most written cell in the first 170 bytes
+};
+
+// Run the workload on the storage functions of one layout
+void run(long cycles, unsigned seed, void (*readFAT)(),
+         int (*addFile)(const char*, int, const char*), void (*removeFile)(int),
+         int (*freeBytes)(), int16_t& noOfFiles, result& r) {
+    memset(EEPROM.data, 0, sizeof(EEPROM.data));
+    readFAT();
+    memset(EEPROM.writes, 0, sizeof(EEPROM.writes));
+    srand(seed);
+    r = result();
+    char data[MAX_FILE_SIZE];
+    for (long cycle = 0; cycle < cycles; cycle++) {
+        bool store = noOfFiles == 0 ||
+                     (noOfFiles < fat::MAX_FILES && rand() % 100 < 55);
+        if (store) {
+            int size = MIN_FILE_SIZE + rand() % (MAX_FILE_SIZE - MIN_FILE_SIZE + 1);
+            char name[12];
+            snprintf(name, sizeof(name), "f%ld", cycle % 100000);
+            for (int i = 0; i < size; i++) data[i] = rand();
+            r.stores++;
+            bool fits = size <= freeBytes();
+            if (addFile(name, size, data) == -1) {
+                r.full++;
+                if (fits) r.lost++;
+            }
+        } else {
+            removeFile(rand() % noOfFiles);
+        }
+    }
+    for (int i = 0; i < EEPROM.length(); i++) {
+        r.total += EEPROM.writes[i];
+        if (EEPROM.writes[i] > r.hottest) {
+            r.hottest = EEPROM.writes[i];
+            r.hottestCell = i;
+        }
+        if (i < 170 && EEPROM.writes[i] > r.metadata) r.metadata = EEPROM.writes[i];
+    }
+}
+
+void print(const char* name, long cycles, const result& r) {
+    double average = (double)r.total / EEPROM.length();
+    printf("%-6s %8ld %8ld %6ld %12lu %10.1f %10lu %6d %10lu %12.0f\n", name, r.stores,
+           r.full, r.lost, r.total, average, r.hottest, r.hottestCell, r.metadata,
+           r.hottest ? (double)RATED_WRITES * cycles / r.hottest : 0.0);
+}
+
+int main(int argc, char* argv[]) {
+    long cycles = argc > 1 ? atol(argv[1]) : 100000;
+    unsigned seed = argc > 2 ? atoi(argv[2]) : 1;
+    if (cycles <= 0) {
+        printf("Usage: %s [<cycles>] [<seed>]\n", argv[0]);
+        return -1;
+    }
+    result fatResult, logResult;
+    run(cycles, seed, fat::readFAT, fat::addFile, fat::removeFile, fat::freeBytes,
+        fat::noOfFiles, fatResult);
+    run(cycles, seed, logfs::readFAT, logfs::addFile, logfs::removeFile,
+        logfs::freeBytes, logfs::noOfFiles, logResult);
+    printf("%ld cycles, seed %u, file sizes %d-%d bytes\n\n", cycles, seed,
+           MIN_FILE_SIZE, MAX_FILE_SIZE);
+    printf("%-6s %8s %8s %6s %12s %10s %10s %6s %10s %12s\n", "layout", "stores", "full",
+           "lost", "writes", "avg/cell", "max/cell", "cell", "max 0-169", "cycles/life");
+    print("FAT", cycles, fatResult);
+    print("log", cycles, logResult);
+    printf("\nlost: stores that failed although FREESPACE reported enough space\n");
+    printf("max/cell: writes to the most written cell, at address cell\n");
+    printf("max 0-169: most written cell where the FAT is stored\n");
+    printf("cycles/life: cycles until the hottest cell reaches %lu writes\n",
+           RATED_WRITES);
+    return 0;
+}
@@ -1,5 +1,5 @@
 typedef struct {
-    char *name;
+    const char *name;
     unsigned char number;
 } instruction;
 
@@ -63,6 +63,14 @@ instruction instrSet[] = {
     {"READCHAR", 57},
     {"READFLOAT", 58},
     {"READSTRING", 59},
+    {"LONG", 60},
+    {"TOLONG", 61},
+    {"FIXED", 62},
+    {"TOFIXED", 63},
+    {"STRINGREF", 64},
+    {"ATTACHEVENT", 65},
+    {"DETACHEVENT", 66},
+    {"WAITEVENT", 67},
     {"IF", 128},
     {"ELSE", 129},
     {"ENDIF", 130},
@@ -72,7 +80,10 @@ instruction instrSet[] = {
     {"ENDLOOP", 134},
     {"STOP", 135},
     {"FORK", 136},
-    {"WAITUNTILDONE", 137}
+    {"WAITUNTILDONE", 137},
+    {"WIDEIF", 138},
+    {"WIDEELSE", 139},
+    {"WIDEWHILE", 140}
 };
 
 int noOfInstr = sizeof(instrSet) / sizeof(instruction);
\ No newline at end of file
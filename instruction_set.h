@@ -57,13 +57,26 @@
 #define READCHAR 57 // lees van file
 #define READFLOAT 58 // lees van file
 #define READSTRING 59 // lees van file
+#define LONG 60 // 4-byte // plaats op stack (eerst de waarde, dan het type)
+#define TOLONG 61 // x
+#define FIXED 62 // 4-byte // Q16.16 fixed-point, plaats op stack (eerst de waarde, dan het type)
+#define TOFIXED 63 // x
+#define STRINGREF 64 // offset length // string uit de constant pool achter de code, plaats op stack (eerst de offset, dan de lengte, dan het type)
+#define ATTACHEVENT 65 // pin mode // koppelt de externe interrupt van pin aan het process (mode: 0 LOW, 1 CHANGE, 2 FALLING, 3 RISING)
+#define DETACHEVENT 66 // pin // ontkoppelt de interrupt van pin
+#define WAITEVENT 67 // blokkeert tot een gekoppelde interrupt afgaat, plaatst de pin op stack (-1 als er geen interrupt gekoppeld is)
 #define IF 128 // lengthOfTrueCode // springt lengthOfTrueCode verder als 0 op stack. waarde blijft staan op stack.
 #define ELSE 129 // lengthOfFalseCode // springt lengthOfFalseCode verder als niet 0 op stack. waarde blijft staan op stack.
 #define ENDIF 130 // popt 1 waarde van de stack
-#define WHILE 131 // lengthOfConditionCode lengthOfRepeatedCode // popt 1 waarde. springt lengthOfRepeatedCode + 1 verder als waarde 0. zoniet, pusht lengthOfConditionCode + lengthOfRepeatedCode + 4 op stack
-#define ENDWHILE 132 // popt 1 waarde en springt zoveel plaatsen terug (naar begin condition code)
+#define WHILE 131 // lengthOfConditionCode lengthOfRepeatedCode // popt 1 waarde. springt lengthOfRepeatedCode + 1 verder als waarde 0.
+#define ENDWHILE 132 // springt terug naar begin condition code (sprongadres wordt bij het starten van het process berekend)
 #define LOOP 133 // geeft aan dat hier setup() eindigt en loop() start
-#define ENDLOOP 134
+#define ENDLOOP 134 // springt terug naar LOOP
 #define STOP 135
 #define FORK 136 // name // start nieuw process, geeft process ID terug
 #define WAITUNTILDONE 137 // processID
+#define WIDEIF 138 // lengthOfTrueCode (2 bytes) // als IF, maar met 16-bit lengte (highbyte eerst)
+#define WIDEELSE 139 // lengthOfFalseCode (2 bytes) // als ELSE, maar met 16-bit lengte (highbyte eerst)
+#define WIDEWHILE 140 // lengthOfConditionCode lengthOfRepeatedCode (elk 2 bytes) // als WHILE, maar met 16-bit lengtes (highbyte eerst)
+#define DICTIONARY 223 // n offset0 .. offsetn // kop van een gecomprimeerd bestand, gevolgd door n macro's en de code
+#define MACRO 224 // 224 t/m 239 // voert macro (opcode - 224) uit het woordenboek uit
@@ -1,1197 +1,4240 @@
-#include <Arduino.h>
-#include <EEPROM.h>
-#include "instruction_set.h"
-
-// CLI
-const int MAX_FILE_NAME_LENGTH = 12;
-static char buffer[4][MAX_FILE_NAME_LENGTH];
-static int bufferCounter = 0;
-static int argumentCounter = 0;
-
-// FAT
-struct FATEntry {
-    char name[12];
-    int beginPosition;
-    int length;
-};
-
-const int MAX_PROCESSES = 10;
-int noOfFiles;
-FATEntry FAT[MAX_PROCESSES];
-
-// MEMORY
-struct variable {
-    byte name;
-    int type;
-    int length;
-    int adress;
-    int procID;
-};
-const int MAX_VARIABLES = 20;
-const int MAXRAM = sizeof(variable) * MAX_VARIABLES;
-int noOfVars = 0;
-variable memoryTable[MAX_VARIABLES];
-byte RAM[MAXRAM];
-
-// PROCESS
-struct process {
-    char name[12];
-    int procID;
-    char state;
-    int sp;
-    int pc;
-    int fp;
-    int address;
-};
-const int PROCESS_TABLE_SIZE = 10;
-int noOfProc;
-int processCounter = 0;
-process processTable[PROCESS_TABLE_SIZE];
-
-// STACK
-const int STACKSIZE = 16;
-byte stack[PROCESS_TABLE_SIZE][STACKSIZE] = {0};
-
-void store();
-void retrieve();
-void erase();
-void files();
-void freespace();
-void run();
-void list();
-void suspend();
-void resume();
-void kill();
-
-typedef struct {
-    char name[MAX_FILE_NAME_LENGTH];
-    void (*func)();
-    int numberOfArguments;
-} commandType;
-
-static commandType commandList[] = {
-    {"store", &store, 2}, {"retrieve", &retrieve, 1},   {"erase", &erase, 1},
-    {"files", &files, 0}, {"freespace", &freespace, 0}, {"run", &run, 1},
-    {"list", &list, 0},   {"suspend", &suspend, 1},     {"resume", &resume, 1},
-    {"kill", &kill, 1},
-};
-
-/*  
- *  |-----------------------------------------------------------------------------------|
- *  |                               Command Line Interface                              |
- *  |-----------------------------------------------------------------------------------|
- */
-// Check whether given function is known
-bool checkCommand() {
-    bool foundMatch = false;
-    int commandLength = sizeof(commandList) / sizeof(commandType);
-    // Loop through known commands
-    for (int i = 0; i < commandLength; i++) {
-        // Function is known
-        if (strcmp(commandList[i].name, buffer[0]) == 0) {
-            // Not enough arguments in call
-            if (argumentCounter != commandList[i].numberOfArguments) {
-                Serial.print(commandList[i].numberOfArguments);
-                Serial.println(F(" arguments required"));
-            } else {
-                foundMatch = true;
-                // Call function
-                void (*func)() = commandList[i].func;
-                func();
-            }
-        }
-    }
-    // Not a known command
-    if (!foundMatch) {
-          Serial.print("Command '");
-          Serial.print(buffer[0]);
-          Serial.println("' is not a known command.");
-          Serial.println("Available commands:");
-          for(auto command : commandList){
-            Serial.println(command.name);
-          }
-    }
-    return foundMatch;
-}
-// Function that updates input buffer
-void inputCLI() {
-    if (Serial.available() > 0) {
-        delayMicroseconds(1042);
-        int receivedChar = Serial.read();
-
-        if (receivedChar == 32) {
-            // Space pressed, go to next argument in buffer
-            argumentCounter++;
-            bufferCounter = 0;
-        } else if (receivedChar == 13 || receivedChar == 10) {
-            // Enter pressed, check command and clear buffer
-            delayMicroseconds(1042);
-            buffer[argumentCounter][bufferCounter] = '\0';
-            Serial.read();
-            checkCommand();
-            for (int i = 0; i < 4; i++) {
-                memset(buffer, 0, MAX_FILE_NAME_LENGTH);
-            }
-            bufferCounter = 0;
-            argumentCounter = 0;
-        } else {
-            // Add char to buffer
-            buffer[argumentCounter][bufferCounter] = receivedChar;
-            bufferCounter++;
-        }
-    }
-}
-// Function validates input on numbers
-bool isNumeric() {
-    for (int i = 0; buffer[1][i] != '\0'; i++) {
-        if (!isdigit(buffer[1][i])) {
-            return false;
-        }
-    }
-    return true;
-}
-
-/*  
- *  |-----------------------------------------------------------------------------------|
- *  |                                       FAT                                         |
- *  |-----------------------------------------------------------------------------------|
- */
-// Function sets FAT entry on given index
-void setFATEntry(int index, const FATEntry& entry) {
-    int address = sizeof(noOfFiles) + (index * sizeof(FATEntry));
-    EEPROM.put(address, entry);
-}
-// Function that returns FAT entry on index
-FATEntry getFATEntry(int index) {
-    FATEntry entry;
-    int address = sizeof(noOfFiles) + (index * sizeof(FATEntry));
-    EEPROM.get(address, entry);
-    return entry;
-}
-// Write data in EEPROM
-void writeFAT() {
-    int address = 0;
-    EEPROM.put(address, noOfFiles);
-    address += sizeof(noOfFiles);
-    for (int i = 0; i < noOfFiles; i++) {
-        EEPROM.put(address, FAT[i]);
-        address += sizeof(FATEntry);
-    }
-}
-// Read FAT from EEPROM
-void readFAT() {
-    int address = 0;
-    EEPROM.get(address, noOfFiles);
-    address += sizeof(noOfFiles);
-    for (int i = 0; i < MAX_PROCESSES; i++) {
-        FAT[i] = getFATEntry(i);
-    }
-}
-// Sort the FAT entries by position
-void sortFAT() {
-    bool sorted = false;
-    while (!sorted) {
-        sorted = true;
-        for (int i = 0; i < noOfFiles - 1; i++) {
-            if (FAT[i].beginPosition > FAT[i + 1].beginPosition) {
-                // Swap the entries
-                FATEntry temp = FAT[i];
-                FAT[i] = FAT[i + 1];
-                FAT[i + 1] = temp;
-                sorted = false;
-            }
-        }
-    }
-}
-// Function finds available position to store file
-int findAvailablePosition(int fileSize) {
-    sortFAT();
-    // Check for space in the first block
-    int systemMemory = (sizeof(FATEntry) * MAX_PROCESSES) + 1;
-
-    int firstBlockEnd = FAT[0].beginPosition + FAT[0].length;
-    if (firstBlockEnd - systemMemory >= fileSize) {
-        return systemMemory;
-    }
-    // Check for space between blocks
-    for (int i = 0; i < noOfFiles - 1; i++) {
-        int currentBlockEnd = FAT[i].beginPosition + FAT[i].length;
-        int nextBlockStart = FAT[i + 1].beginPosition;
-        int availableSpace = nextBlockStart - currentBlockEnd;
-        if (availableSpace >= fileSize) {
-            return currentBlockEnd;
-        }
-    }
-    // Check for space in last block
-    int lastBlockEnd = FAT[noOfFiles - 1].beginPosition + FAT[noOfFiles - 1].length;
-    int remainingSpace = EEPROM.length() - lastBlockEnd;
-    if (remainingSpace >= fileSize) {
-        if (noOfFiles == 0) {
-            return lastBlockEnd + systemMemory;
-        }
-        return lastBlockEnd;
-    }
-    // No space available
-    return -1;
-}
-
-// Function returns the index of the file in FAT
-int getFileInFAT(const char* fileName) {
-    // Load FAT from EEPROM
-    readFAT();
-    for (int i = 0; i < noOfFiles; i++) {
-        if (strcmp(FAT[i].name, fileName) == 0) {
-            return i;
-        }
-    }
-    return -1;
-}
-// Function s file
-void storeFile(const char* filename, int fileSize) {
-    Serial.println(F("Give input for file:"));
-    char fileData[fileSize];
-    // Wait for data
-    while (Serial.available() == 0) {
-        
-    }
-
-    for (int i = 0; i < fileSize; i++) {
-        if (Serial.available() != 0) {
-            // Add data to filedata
-            fileData[i] = Serial.read();
-        } else {
-            fileData[i] = 32;
-        }
-        delayMicroseconds(1042);
-    }
-
-    // Clear Serial buffer
-    while (Serial.available()) {
-        Serial.read();
-        delayMicroseconds(1042);
-    }
-    // Get most recent FAT
-    readFAT();
-
-    if (noOfFiles >= MAX_PROCESSES) {
-        Serial.println(F("File cannot be stored, limit reached."));
-        return;
-    }
-    if (getFileInFAT(filename) != -1) {
-        Serial.println(F("File cannot be stored, given name already exists."));
-        return;
-    }
-
-    // Find available position to store the file
-    int position = findAvailablePosition(fileSize);
-    if (position == -1) {
-        Serial.println(F("Error: No space left for file."));
-        return;
-    }
-
-    // Make new FATEntry with new data
-    FATEntry file = {};
-    strcpy(file.name, filename);
-    file.beginPosition = position;
-    file.length = fileSize;
-
-    // Write the FAT entry to the EEPROM
-    FAT[noOfFiles] = file;
-    noOfFiles++;
-    sortFAT();
-    writeFAT();
-    // Write data to the EEPROM
-    fileSize++;
-    for (int i = 0; i < fileSize; i++) {
-        EEPROM.write(position, fileData[i]);
-        position++;
-    }
-
-    Serial.println(F("File has been stored."));
-}
-
-// Function to retrieve and print a file from the file system
-void retrieveFile(const char* filename) {
-    // Get most recent FAT
-    readFAT();
-
-    // Check if file exists
-    int fatIndex = getFileInFAT(filename);
-    if (fatIndex == -1) {
-        Serial.println(F("File not found."));
-        return;
-    }
-
-    int fileIndex = FAT[fatIndex].beginPosition;
-
-    Serial.print(F("\nContent: "));
-    for (int i = 0; i < FAT[fatIndex].length; i++) {
-        Serial.print((char)EEPROM.read(fileIndex));
-        fileIndex++;
-    }
-    Serial.print(F("\n"));
-    Serial.println(F("End of File Content."));
-}
-// Function erases file
-void eraseFile(const char* fileName) {
-    // Get most recent FAT
-    readFAT();
-    int fatIndex = getFileInFAT(fileName);
-    if (fatIndex == -1) {
-        Serial.println(F("File not found."));
-        return;
-    }
-    // Move other entries to the left
-    for (int i = fatIndex; i < noOfFiles; i++) {
-        FAT[i] = FAT[i + 1];
-    }
-    // Make last entry empty
-    FATEntry emptyEntry;
-    FAT[noOfFiles - 1] = emptyEntry;
-    noOfFiles--;
-
-    writeFAT();
-    Serial.print(F("Erased: "));
-    Serial.println(fileName);
-}
-// Function returns the available free space
-void freespaceEEPROM() {
-    // Get most recent FAT
-    readFAT();
-
-    int systemMemory = (sizeof(FATEntry) * MAX_PROCESSES) + 1;
-    // Add total file sizes
-    int usedSpace = 0;
-    for (int i = 0; i < noOfFiles; i++) {
-        usedSpace += FAT[i].length;
-    }
-    int totalAvailable = EEPROM.length() - systemMemory - usedSpace;
-    Serial.print(F("Available space: "));
-    Serial.println(totalAvailable);
-}
-// Print FAT
-void printFAT() {
-    readFAT();  // Read the FAT from EEPROM
-    Serial.println();
-    Serial.print(noOfFiles);
-    Serial.println(F(" files found"));
-
-    for (int i = 0; i < noOfFiles; i++) {
-        Serial.print(F("File "));
-        Serial.print(i);
-        Serial.print(F(": Name="));
-        Serial.print(FAT[i].name);
-        Serial.print(F("     \tAddress = "));
-        Serial.print(FAT[i].beginPosition);
-        Serial.print(F("\tLength = "));
-        Serial.println(FAT[i].length);
-    }
-    Serial.println();
-}
-// Clear EEPROM
-void clearEeprom() {
-    for (int i = 0; i < EEPROM.length(); i++) {
-        EEPROM.write(i, 0);
-    }
-    Serial.println(F("\nEEPROM CLEARED\n"));
-}
-
-/*  
- *  |-----------------------------------------------------------------------------------|
- *  |                                       STACK                                       |
- *  |-----------------------------------------------------------------------------------|
- */
-void pushByte(int procID, int& sp, byte b) { stack[procID][sp++] = b; }
-byte popByte(int procID, int& sp) {
-    return stack[procID][--sp];
-}
-
-void pushChar(int procID, int& sp, char c) {
-    pushByte(procID, sp, c);
-    // Push char
-    pushByte(procID, sp, 0x01);
-}
-char popChar(int procID, int& sp) {
-    return popByte(procID, sp);
-}
-
-void pushInt(int procID, int& sp, int i) {
-    pushByte(procID, sp, highByte(i));
-    pushByte(procID, sp, lowByte(i));
-    // Push int
-    pushByte(procID, sp, 0x02);
-}
-int popInt(int procID, int& sp) {
-    byte lb = popByte(procID, sp);
-    byte hb = popByte(procID, sp);
-    int i = word(hb, lb);
-    return i;
-}
-
-void pushFloat(int procID, int& sp, float f) {
-    byte* b = (byte*)&f;
-    for (int i = 3; i >= 0; i--) {
-        // Push bytes beginning with highbytes
-        pushByte(procID, sp, b[i]);
-    }
-    // Push float
-    pushByte(procID, sp, 0x04);
-}
-float popFloat(int procID, int& sp) {
-    byte b[4];
-    for (int i = 0; i < 4; i++) {
-        // Pop bytes beginning with lowbytes
-        byte temp = popByte(procID, sp);
-        b[i] = temp;
-    }
-
-    float* f = (float*)b;
-    return *f;
-}
-
-void pushString(int procID, int& sp, char* s) {
-    for (int i = 0; i < strlen(s); i++) {
-        pushByte(procID, sp, s[i]);
-    }
-    // Push terminating zero
-    pushByte(procID, sp, 0x00);
-    // Push length
-    pushByte(procID, sp, strlen(s) + 1);
-    // Push string
-    pushByte(procID, sp, 0x03);
-}
-char* popString(int procID, int& sp, int size) {
-    char* temp = new char[size];
-    // Pop string including terminating zero
-    for (int i = size - 1; i >= 0; i--) {
-        byte letter = popByte(procID, sp);
-        temp[i] = letter;
-    }
-    return temp;
-}
-
-float popVal(int procID, int& sp, int type) {
-    switch (type) {
-        // Char
-        case 1:
-        {
-            return popChar(procID, sp);
-            break;
-        }
-        // Int
-        case 2:
-        {
-            return popInt(procID, sp);
-            break;
-        }
-        // Float
-        case 4:
-        {
-            return popFloat(procID, sp);
-            break;
-        }
-        default:
-            break;
-    }
-}
-
-/*  
- *  |-----------------------------------------------------------------------------------|
- *  |                                       MEMORY                                      |
- *  |-----------------------------------------------------------------------------------|
- */
-// Save char to memory
-void saveChar(char c, int adress) { RAM[adress] = c; }
-// Load char from memory
-char loadChar(int adress) { return RAM[adress]; }
-// Save int to memory
-void saveInt(int i, int adress) {
-    RAM[adress] = highByte(i);
-    RAM[adress + 1] = lowByte(i);
-}
-// Load int from memory
-int loadInt(int adress) {
-    byte hb = RAM[adress];
-    byte lb = RAM[adress + 1];
-    // Return merged
-    return word(hb, lb);
-}
-// Save float to memory
-void saveFloat(float f, int adress) {
-    byte *b = (byte *)&f;
-    // Push bytes starting with highbytes
-    for (int i = 3; i >= 0; i--) {
-        RAM[adress + i] = b[i];
-    }
-}
-// Load float from memory
-float loadFloat(int adress) {
-    byte b[4];
-    // Pop bytes starting with lowbytes
-    for (int i = 0; i < 4; i++) {
-        b[i] = RAM[adress + i];
-    }
-
-    float *f = (float *)b;
-    return *f;
-}
-// Save string to memory
-void saveString(char *s, int adress) {
-    // Save chars
-    for (int i = 0; i < strlen(s); i++) {
-        RAM[adress + i] = s[i];
-    }
-    // Save terminating zero
-    RAM[adress + strlen(s)] = 0x00;
-}
-// Load string from memory
-char *loadString(int adress, int length) {
-    char *temp = new char[length];
-    // Pop chars including terminating zero
-    for (int i = length - 1; i >= 0; i--) {
-        temp[i] = RAM[adress + i];
-    }
-    return temp;
-}
-// Sort the memoryTable entries by position
-void sortMemory() {
-    bool sorted = false;
-    while (!sorted) {
-        sorted = true;
-        for (int i = 0; i < noOfVars - 1; i++) {
-            if (memoryTable[i].adress > memoryTable[i + 1].adress) {
-                // Swap them
-                variable temp = memoryTable[i];
-                memoryTable[i] = memoryTable[i + 1];
-                memoryTable[i + 1] = temp;
-                sorted = false;
-            }
-        }
-    }
-}
-// Function checks for available space in memory
-int getAvailableSpace(int size) {
-    // Check first block
-    if (memoryTable[0].adress >= size) {
-        return 0;
-    }
-
-    // Check between blocks
-    for (int i = 0; i < noOfVars - 1; i++) {
-        int availableSpace = memoryTable[i + 1].adress - (memoryTable[i].adress + memoryTable[i].length);
-        if (availableSpace >= size) {
-            return memoryTable[i].adress + memoryTable[i].length;
-        }
-    }
-
-    // Check last block
-    int lastEntry = memoryTable[noOfVars - 1].adress + memoryTable[noOfVars - 1].length;
-    if (MAXRAM - (int)lastEntry >= size) {
-        return lastEntry;
-    }
-
-    Serial.println("No space found");
-    return -1;
-}
-
-int findFileInMemory(byte name, int procID) {
-    for (int i = 0; i < noOfVars; i++) {
-        if (memoryTable[i].name == name && memoryTable[i].procID == procID) {
-            return i;
-        }
-    }
-    return -1;  // Not found
-}
-
-void addMemoryEntry(byte name, int procID, int &stackP) {
-    // Check if there is space in the memory table
-    if (noOfVars >= MAX_VARIABLES) {
-        Serial.print(F("Error. Not enough space in the memory table"));
-        return;
-    }
-
-    // Check if variable is already in memorytable and should be overwritten
-    int index = findFileInMemory(name, procID);
-
-    if (index != -1) {
-        // Shift variables to delete one
-        for (int i = index; i < noOfVars; i++) {
-            memoryTable[i] = memoryTable[i + 1];
-        }
-        noOfVars--;
-    }
-    // Index is after last var
-    index = noOfVars;
-
-    int type = popByte(procID, stackP);
-    int size = (type != 3) ? type : popByte(procID, stackP);
-    sortMemory();
-
-    int newAdress = (noOfVars > 0) ? getAvailableSpace(size) : 0;
-    variable newVariable = {.name = name,
-                            .type = type,
-                            .length = size,
-                            .adress = newAdress,
-                            .procID = procID};
-
-    memoryTable[index] = newVariable;
-
-    switch (type) {
-        case 1: {
-            // Char
-            saveChar(popVal(procID, stackP, type), newAdress);
-            break;
-        }
-        case 2: {
-            // Int
-            saveInt(popVal(procID, stackP, type), newAdress);
-            break;
-        }
-        case 3: {
-            // String
-            char *s = popString(procID, stackP, size);
-            saveString(s, newAdress);
-            break;
-        }
-        case 4: {
-            // Float
-            saveFloat(popVal(procID, stackP, type), newAdress);
-            break;
-        }
-        default:
-            break;
-    }
-
-    noOfVars++;
-}
-
-void getMemoryEntry(byte name, int procID, int &stackP) {
-    int index = findFileInMemory(name, procID);
-    if (index == -1) {
-        Serial.println("Error. This variable doesn't exist.");
-        return;
-    }
-
-    int type = memoryTable[index].type;
-    int length = memoryTable[index].length;
-    switch (type) {
-        case 1: {
-            // Char
-            char temp = loadChar(memoryTable[index].adress);
-            pushChar(procID, stackP, temp);
-            break;
-        }
-        case 2: {
-            // Int
-            int temp = loadInt(memoryTable[index].adress);
-            pushInt(procID, stackP, temp);
-            break;
-        }
-        case 3: {
-            // String
-            pushString(procID, stackP, loadString(memoryTable[index].adress, length));
-            break;
-        }
-        case 4: {
-            // Float
-            pushFloat(procID, stackP, loadFloat(memoryTable[index].adress));
-            break;
-        }
-        default:
-            break;
-    }
-}
-
-void deleteVars(int procID) {
-    // Delete all variables for a process
-    for (int j = 0; j < noOfVars; j++) {
-        if (memoryTable[j].procID == procID) {
-            for (int i = j; i < noOfVars; i++) {
-                memoryTable[i] = memoryTable[i + 1];
-            }
-            noOfVars--;
-        }
-    }
-}
-
-/*  
- *  |-----------------------------------------------------------------------------------|
- *  |                                       PROCESS                                     |
- *  |-----------------------------------------------------------------------------------|
- */
-
-int getPid(int id)
-// Find the index of a process in the process
-{
-    for (int i = 0; i < noOfProc; i++) {
-        if (processTable[i].procID == id) {
-            // Return index
-            return i;
-        }
-    }
-    return -1;
-}
-
-void changeProcessState(int processIndex, char state) {
-    // Change the state of a process in the process table
-    if (state != 'r' && state != 'p' && state != '0') {
-        Serial.println(F("Not a valid state"));
-        return;
-    }
-    if (processTable[processIndex].state == state) {
-        Serial.print(F("Process already is in "));
-        Serial.print(state);
-        Serial.println(F(" state"));
-        return;
-    }
-    processTable[processIndex].state = state;
-}
-
-void runProcess(const char *filename) {
-    // Run a new process
-
-    // Check if process table has space
-    if (noOfProc >= PROCESS_TABLE_SIZE) {
-        Serial.println(F("Error. Not enough space in the process table"));
-        return;
-    }
-    // Check if file exists
-    int fileIndex = getFileInFAT(filename);
-    
-    if (fileIndex == -1) {
-        Serial.println(F("File does not exist."));
-        return;
-    }
-
-    // Initialize a new process with default values
-    process newProcess;
-
-    // Copy the filename to the process name
-    strcpy(newProcess.name, filename);
-    newProcess.procID = processCounter++;
-    newProcess.state = 'r';
-    newProcess.pc = 0;
-    newProcess.fp = 0;
-    newProcess.sp = 0;
-    newProcess.address = FAT[fileIndex].beginPosition;
-
-    processTable[noOfProc++] = newProcess;
-
-    Serial.print(F("Proces: "));
-    Serial.print(newProcess.procID);
-    Serial.println(F(" has been started"));
-}
-
-// Suspend a process by changing its state to paused
-void suspendProcess(int id) {
-    Serial.print(F("Suspending process "));
-    Serial.println(id);
-    int processIndex = getPid(id);
-    if (processIndex == -1) {
-        Serial.println(F("processId doesn't exist"));
-        return;
-    }
-
-    if (processTable[processIndex].state == '0') {
-        Serial.println(F("Process already ended"));
-        return;
-    }
-
-    changeProcessState(processIndex, 'p');
-    Serial.print(F("Process with PID: "));
-    Serial.print(id);
-    Serial.println(F(" has been suspended."));
-}
-
-// Resume a suspended process by changing its state to running
-void resumeProcess(int id) {
-    int processIndex = getPid(id);
-    if (processIndex == -1) {
-        Serial.println(F("processId doesn't exist"));
-        return;
-    }
-
-    if (processTable[processIndex].state == '0') {
-        Serial.println(F("Process already ended"));
-        return;
-    }
-
-    changeProcessState(processIndex, 'r');
-    Serial.print(F("Process with PID: "));
-    Serial.print(id);
-    Serial.println(F(" has been resumed."));
-}
-
-// Stop a process by changing its state to terminated
-void stopProcess(int id) {
-    int processIndex = getPid(id);
-    if (processIndex == -1) {
-        Serial.println(F("processId doesn't exist"));
-        return;
-    }
-
-    if (processTable[processIndex].state == '0') {
-        Serial.println(F("Process already ended"));
-        return;
-    }
-    // Delete all variables of process from memory
-    deleteVars(id);
-    changeProcessState(processIndex, '0'); // Change to terminated
-
-    // Delete process from processTable
-    for (int j = 0; j < noOfProc; j++) {
-        if (processTable[j].procID == id) {
-            for (int i = j; i < noOfProc; i++) {
-                processTable[i] = processTable[i + 1];
-            }
-        }
-    }
-    Serial.print(F("Process with PID: "));
-    Serial.print(id);
-    Serial.println(F(" has been killed."));
-    noOfProc--;
-}
-
-// Show the list of processes with their ID, state, and name
-void showProcesses() {
-    Serial.println(F("List of active processes:"));
-
-    for (int i = 0; i < noOfProc; i++) {
-        if (processTable[i].state != '0') {
-            Serial.print(F("PID: "));
-            Serial.print(processTable[i].procID);
-            Serial.print(F(" - Status: "));
-            Serial.print(processTable[i].state);
-            Serial.print(F(" - Name: "));
-            Serial.println(processTable[i].name);
-        }
-    }
-}
-
-float increment(int type, float value) { return value + 1; }
-float decrement(int type, float value) { return value - 1; }
-
-typedef struct {
-    int operatorName;
-    float (*func)(int type, float value);
-    int returnType;
-} unaryFunction;
-
-unaryFunction unary[] = {
-    {INCREMENT, &increment, 0},
-    {DECREMENT, &decrement, 0},
-};
-
-float plus(float x, float y) { return x + y; }
-float minus(float x, float y) { return x - y; }
-
-typedef struct {
-    int operatorName;
-    float (*func)(float x, float y);
-    int returnType;
-} binaryFunction;
-
-binaryFunction binary[] = {
-    {PLUS, &plus, 0},
-    {MINUS, &minus, 0}
-};
-
-// Function to find the index of a unary function in the unary array
-int findUnaryFunction(int operatorNum) {
-    for (int i = 0; i < 2; i++) {
-        if (unary[i].operatorName == operatorNum) {
-            return i;
-        }
-    }
-    return -1;
-}
-
-// Function to find the index of a binary function in the binary array
-int findBinaryFunction(int operatorNum) {
-    for (int i = 0; i < 2; i++) {
-        if (binary[i].operatorName == operatorNum) {
-            return i;
-        }
-    }
-    return -1;
-}
-
-// Function to execute a process at a given index in the processTable
-void execute(int index) {
-    int address = processTable[index].address;
-    int procID = processTable[index].procID;
-    int& stackP = processTable[index].sp;
-    byte currentCommand = EEPROM.read(address + processTable[index].pc);
-    processTable[index].pc++;
-    switch (currentCommand) {
-        case CHAR: {
-            // Handle CHAR bytecode
-            char temp = (char)EEPROM.read(address + processTable[index].pc++);
-            pushChar(procID, stackP, temp);
-            break;
-        }
-        case INT: {
-            // Handle INT bytecode
-            int highByte = EEPROM.read(address + processTable[index].pc++);
-            int lowByte = EEPROM.read(address + processTable[index].pc++);
-            pushInt(procID, stackP, word(highByte, lowByte));
-            break;
-        }
-        case STRING: {
-            // Handle STRING bytecode
-            char string[12];
-            memset(&string[0], 0, sizeof(string));  // Empty string
-            int pointer = 0;
-            do {
-                int temp = (int)EEPROM.read(address + processTable[index].pc++);
-                string[pointer] = (char)temp;
-                pointer++;
-            } while (string[pointer - 1] != 0);
-
-            pushString(procID, stackP, string);
-            break;
-        }
-        case FLOAT: {
-            // Handle FLOAT bytecode
-            byte b[4];
-            for (int i = 3; i >= 0; i--) {
-                byte temp = EEPROM.read(address + processTable[index].pc++);
-                b[i] = temp;
-            }
-            float* f = (float*)b;
-            pushFloat(procID, stackP, *f);
-            break;
-        }
-        case STOP: {
-            // Handle STOP bytecode
-            Serial.print(F("Process with pid: "));
-            Serial.print(procID);
-            Serial.println(F(" is finished."));
-            deleteVars(procID);
-            stopProcess(procID);
-            Serial.println();
-            break;
-        }
-        case 51 ... 52: {  // PRINT and PRINTLN
-            // Handle PRINT and PRINTLN commands
-            int type = popByte(procID, stackP);
-            switch (type) {
-                case CHAR: {
-                    Serial.print(popChar(procID, stackP));
-                    break;
-                }
-                case INT: {
-                    Serial.print(popInt(procID, stackP));
-                    break;
-                }
-                case STRING: {
-                    int size = popByte(procID, stackP);
-                    Serial.print(popString(procID, stackP, size));
-                    break;
-                }
-                case FLOAT: {
-                    Serial.print(popFloat(procID, stackP), 5);
-                    break;
-                }
-                default:
-                    break;
-            }
-            if (currentCommand == 52) {
-                Serial.println();
-            }
-            break;
-        }
-        case SET: {
-            // Handle SET bytecode
-            char name = EEPROM.read(address + processTable[index].pc++);
-
-            addMemoryEntry(name, procID, stackP);
-            break;
-        }
-        case GET: {
-            // Handle GET bytecode
-            char name = EEPROM.read(address + processTable[index].pc++);
-            getMemoryEntry(name, procID, stackP);
-            break;
-        }
-        case DELAY: {
-            break;
-        }
-        case DELAYUNTIL: {
-            popByte(procID, stackP);
-            int temp = popInt(procID, stackP);
-            int mil = millis();
-            if (temp > mil) {
-                processTable[index].pc--;
-                pushInt(procID, stackP, temp);
-            }
-            break;
-        }
-        case MILLIS: {
-            pushInt(procID, stackP, millis());
-            break;
-        }
-        case PINMODE: {
-            popByte(procID, stackP);
-            int direction = popInt(procID, stackP);
-            popByte(procID, stackP);
-            int pin = popInt(procID, stackP);
-            pinMode(pin, direction);
-            break;
-        }
-        case DIGITALWRITE: {
-            popByte(procID, stackP);
-            int status = popInt(procID, stackP);
-            popByte(procID, stackP);
-            int pin = popInt(procID, stackP);
-            digitalWrite(pin, status);
-            break;
-        }
-        case FORK: {
-            int type = popByte(procID, stackP);
-            int size = popByte(procID, stackP);
-            char* fileName = popString(procID, stackP, size);
-            runProcess(fileName);
-            pushInt(procID,stackP,procID+1);
-            break;
-        }
-        case WAITUNTILDONE: {
-            popByte(procID,stackP);
-            int runningID = popInt(procID, stackP);
-            char state = processTable[runningID].state;
-            if(state == 'r' || state == 'p') {
-                processTable[procID].pc--;
-                pushInt(procID, stackP, runningID);
-            } 
-            break;
-        }
-        case 7 ... 8: {
-            // Handle unary functions
-            int type = popByte(procID, stackP);
-            float value = popVal(procID, stackP, type);
-
-            float newValue = unary[findUnaryFunction(currentCommand)].func(type, value);
-
-            switch (type) {
-                case CHAR: {
-                    pushChar(procID, stackP, (char)newValue);
-                    break;
-                }
-                case INT: {
-                    pushInt(procID, stackP, (int)newValue);
-                    break;
-                }
-                case FLOAT: {
-                    pushFloat(procID, stackP, (float)newValue);
-                    break;
-                }
-                default:
-                    Serial.println(F("Execute: Default case"));
-                    break;
-            }
-            break;
-        }
-        case 9 ... 10: {
-            int typeY = popByte(procID, stackP);
-            float y = popVal(procID, stackP, typeY);
-            int typeX = popByte(procID, stackP);
-            float x = popVal(procID, stackP, typeY);
-
-            float newValue = binary[findBinaryFunction(currentCommand)].func(x, y);
-            int returnType = max(typeY, typeX);
-            switch (returnType) {
-                case CHAR: {
-                    pushChar(procID, stackP, (char)newValue);
-                    break;
-                }
-                case INT: {
-                    pushInt(procID, stackP, (int)newValue);
-                    break;
-                }
-                case FLOAT: {
-                    pushFloat(procID, stackP, (float)newValue);
-                    break;
-                }
-                default:
-                    Serial.println(F("Execute: Default case"));
-                    break;
-            }
-            break;
-        }
-        default: {
-            Serial.println(F("Error. Unkown commandList."));
-            break;
-        }
-    }
-}
-
-void runProcesses() {
-    for (int i = 0; i < noOfProc; i++) {
-        if (processTable[i].state == 'r') {
-            execute(i);
-        }
-    }
-}
-
-void setup() {
-    Serial.begin(9600);
-    Serial.println(F("\nArduinOS 1.0 ready.\n"));
-}
-
-void loop() {
-    inputCLI();
-    runProcesses();
-}
-
-void store() {
-    // Store a file in the file system
-    storeFile(buffer[1], atoi(buffer[2]));
-}
-void retrieve() {
-    // Retrieve a file from the file system
-    retrieveFile(buffer[1]);
-}
-void erase() {
-    // Delete a file
-    eraseFile(buffer[1]);
-}
-void files() {
-    // Print a list of stored files
-    printFAT();
-}
-void freespace() {
-    // Print the available space in file system
-    freespaceEEPROM();
-}
-void run() {
-    // Start a program
-    runProcess(buffer[1]);
-}
-void list() {
-    //show active status of running programs
-    showProcesses();
-}
-void suspend() {
-    // Suspend a process
-    if (isNumeric()) {
-        suspendProcess(atoi(buffer[1]));
-    } else {
-        Serial.println(F("Error. Invalid process ID."));
-    }
-}
-void resume() {
-    // Resume a process
-    if (isNumeric()) {
-        resumeProcess(atoi(buffer[1]));
-    } else {
-        Serial.println(F("Error. Invalid process ID."));
-    }
-}
-void kill() {
-    // Stop a process
-    if (isNumeric()) {
-        stopProcess(atoi(buffer[1]));
-    } else {
-        Serial.println(F("Error. Invalid process ID."));
-    }
-}
\ No newline at end of file
+#include <Arduino.h>
+#include <EEPROM.h>
+#include "instruction_set.h"
+
+// OPTIONS
+#ifndef DUMP_ENABLED
+#define DUMP_ENABLED 1  // DUMP <file> command, costs about 1 KiB of flash
+#endif
+#ifndef PROFILING_ENABLED
+#define PROFILING_ENABLED 0  // Per-opcode and per-process counters, STATS command
+#endif
+#ifndef LOG_STRUCTURED_ENABLED
+#define LOG_STRUCTURED_ENABLED 0  // Append files to a log around the EEPROM instead of the FAT
+#endif
+#ifndef SD_ENABLED
+#define SD_ENABLED 0  // Keep the file system on an SD card instead of the EEPROM
+#endif
+#ifndef ROM_FILES_ENABLED
+#if __has_include("romfiles.h")
+#define ROM_FILES_ENABLED 1  // Read-only files in flash from romfiles.h, see "convert -c"
+#else
+#define ROM_FILES_ENABLED 0
+#endif
+#endif
+#ifndef WATCHDOG_ENABLED
+#define WATCHDOG_ENABLED 1  // Reset by the hardware watchdog when the interpreter hangs
+#endif
+#ifndef EDF_ENABLED
+#define EDF_ENABLED 0  // SCHED edf and deadline misses in LIST, costs 11 bytes of RAM per process
+#endif
+#ifndef INSTRUCTION_BUDGET
+#define INSTRUCTION_BUDGET 0  // Instructions a process may run without waiting, 0 for no limit
+#endif
+
+#if SD_ENABLED
+#if LOG_STRUCTURED_ENABLED
+#error "The log-structured mode is meant for the EEPROM"
+#endif
+#include <SPI.h>
+#include <SD.h>
+// The card has room for more files, a file system of n files has at most
+// n + 1 free extents
+#define MAX_EXTENTS 17
+#endif
+#include "allocator.h"
+#if WATCHDOG_ENABLED
+#include <avr/wdt.h>
+#endif
+
+// CLI
+const int MAX_FILE_NAME_LENGTH = 12;
+static char buffer[4][MAX_FILE_NAME_LENGTH];
+static int bufferCounter = 0;
+static int argumentCounter = 0;
+
+// STORAGE
+// Block device holding the file system. The FAT, file I/O and instruction
+// fetch only use these functions, so the backend can be exchanged.
+struct blockDevice {
+    byte (*read)(int address);
+    void (*update)(int address, byte value);  // Writes only changed bytes
+    void (*flush)();  // Write cached data back
+    int size;
+};
+// File positions from ROM_BASE on are in the ROM image in flash
+const int ROM_BASE = 0x6000;
+#if SD_ENABLED
+// The first 32 KiB of the card as raw blocks, FAT positions are 16-bit. One
+// sector is cached, writes are collected in it until another sector is needed
+// or the cache is flushed. Instruction fetch and file data share it: a program
+// that writes a file in another sector than its code makes every flush of the
+// block cache write the data sector and read the code sector again. A second
+// sector would cost another 512 bytes of RAM.
+const int SD_CHIP_SELECT = 10;
+const int SECTOR_SIZE = 512;
+const int SD_SIZE = ROM_FILES_ENABLED ? ROM_BASE : 32767;
+Sd2Card card;
+byte sectorCache[SECTOR_SIZE];
+long cachedSector = -1;
+bool sectorDirty = false;
+#endif
+
+// FAT
+struct FATEntry {
+    char name[12];
+    int16_t beginPosition;
+    int16_t length;
+};
+
+const int MAX_FILES = SD_ENABLED ? 16 : 10;
+int16_t noOfFiles;
+FATEntry FAT[MAX_FILES];
+#if ROM_FILES_ENABLED
+// romfiles.h defines romImage and romFiles, the positions in romFiles are
+// offsets in romImage. getFileInFAT returns ROM_INDEX + i for romFiles[i].
+#include "romfiles.h"
+const int NO_OF_ROM_FILES = sizeof(romFiles) / sizeof(romFiles[0]);
+const int ROM_INDEX = MAX_FILES;
+static_assert(sizeof(romImage) <= 0x8000 - ROM_BASE, "ROM image too large");
+#endif
+#if !LOG_STRUCTURED_ENABLED
+// EEPROM slot of every FAT entry, a slot with an empty name is free
+byte fatSlot[MAX_FILES];
+// The EEPROM starts with a header and the FAT slots, files are stored behind
+// them. Older layouts start with the number of files instead of the header,
+// or with FAT_MAGIC_V1 and a journal of one record.
+const int16_t FAT_MAGIC = 0x4246;
+const int16_t FAT_MAGIC_V1 = 0x4146;
+const int SYSTEM_MEMORY = sizeof(noOfFiles) + sizeof(FAT);
+// The journal at the end of the EEPROM holds the last FAT updates in two
+// records that are written in turn, so a reset during an update is repaired
+// at startup. The generation is written last: until then the other record
+// is the newest, and no write is needed to invalidate a record first.
+struct journalRecord {
+    FATEntry entry;
+    int16_t from;  // Old position of a file that slides down, -1 if the data stays
+    byte check;
+    byte slot;
+    uint16_t seq;  // Generation, one higher than that of the other record
+};
+// Every record is followed by the progress of its slide
+const int JOURNAL_RECORD_SIZE = sizeof(journalRecord) + sizeof(uint16_t);
+const int JOURNAL_SIZE = 2 * JOURNAL_RECORD_SIZE;
+// The single record of the FAT_MAGIC_V1 layout had no generation
+const int JOURNAL_V1_SIZE = JOURNAL_RECORD_SIZE - sizeof(uint16_t);
+byte journalNext = 0;     // Record that the next update is written to
+uint16_t journalSeq = 0;  // Generation of the next update
+// Free space between and behind the files
+extentList freeExtents;
+#else
+// Every file is a record in a log that wraps around the EEPROM, so no cell
+// is rewritten more often than the others. The FAT only lives in RAM and is
+// rebuilt from the records at startup. Erasing a file clears the live flag of
+// its record, the oldest records are reclaimed when space is needed and live
+// ones are appended again.
+struct logHeader {
+    byte live;       // LOG_LIVE, cleared when the file is erased
+    byte signature;  // LOG_SIGNATURE
+    int16_t seq;     // Sequence number, one higher for every record
+    int16_t length;  // Data bytes behind the header
+    char name[12];
+    uint16_t check;  // Fletcher-16 of the header without live and check
+};
+const byte LOG_LIVE = 0xA5;
+const byte LOG_SIGNATURE = 0x4C;
+const int HEADER_SIZE = sizeof(logHeader);
+// At most this many records fit in the EEPROM
+const int MAX_RECORDS = 1024 / sizeof(logHeader);
+int logHead = 0;     // Where the next record is written
+int logTail = 0;     // Oldest record, equal to logHead when the log is empty
+int16_t logSeq = 0;  // Sequence number of the next record
+#endif
+
+// FILE I/O
+// Block cache shared by the open files, written bytes go back with
+// EEPROM.update when another block is needed or a file is closed. A block
+// may hold parts of other files and of the FAT, so only the bytes that files
+// have written are written back.
+const int BLOCK_SIZE = 16;
+byte blockCache[BLOCK_SIZE];
+int blockAddress = -1;
+uint16_t dirtyBytes = 0;  // One bit per byte of the block
+
+// MEMORY
+struct variable {
+    byte name;
+    int type;
+    int length;
+    int adress;
+    int procID;
+};
+const int MAX_VARIABLES = 20;
+const int MAXRAM = sizeof(variable) * MAX_VARIABLES;
+int noOfVars = 0;
+variable memoryTable[MAX_VARIABLES];
+byte RAM[MAXRAM];
+
+// PROCESS
+struct jump {
+    int from;
+    int to;
+};
+// The jump tables of the loaded programs share one pool. A table is a hash
+// table sized to the branches of its program, about three quarters full.
+const int JUMP_POOL_SIZE = 48;
+const int MAX_WHILE_DEPTH = 8;
+const int MAX_MACROS = 16;  // Opcodes MACRO up to MACRO + 15 of a compressed file
+
+struct process {
+    char name[12];
+    int procID;
+    char state;  // r(unning), w(aiting in DELAYUNTIL), e (waiting in WAITEVENT), p(aused) or 0 (free slot)
+    signed char next;  // Neighbours in the ready or sleep list
+    signed char prev;
+    int sp;
+    int pc;
+    int fp;
+    int address;
+    byte program;  // Index in the program table
+    byte macroPos;  // Next byte of the macro being expanded
+    byte macroEnd;  // End of the macro being expanded, 0 if none
+    int fileAddress;  // Open file, -1 if none
+    int fileLength;
+    int filePosition;
+    byte priority;
+    uint16_t pass;
+    uint16_t instructions;  // Wraps around, like the other counters
+    bool sleeping;       // Waiting in DELAYUNTIL until release
+    uint32_t release;    // Target of the last DELAYUNTIL
+#if EDF_ENABLED
+    bool periodic;       // Has reached a DELAYUNTIL, so it has a deadline
+    int32_t period;      // Distance between the last two DELAYUNTIL targets
+    uint16_t misses;     // DELAYUNTIL targets that had passed on arrival
+    int32_t maxLateness; // Largest miss in ms
+#endif
+    uint16_t budget;     // Instructions allowed without waiting, 0 for no limit
+    uint16_t sinceWait;  // Instructions since the process last waited
+#if PROFILING_ENABLED
+    unsigned long cpuMicros;
+#endif
+};
+const int PROCESS_TABLE_SIZE = 10;
+int noOfProc;
+// Processes running the same file share its resolved jump table
+struct program {
+    int address;
+    byte codeStart;  // Offset of the code, behind the dictionary of a compressed file
+    byte users;
+    byte firstJump;  // Jump table in jumpPool, 1 << jumpBits entries
+    byte jumpBits;   // 0 if the program has no branches
+};
+program programTable[PROCESS_TABLE_SIZE];
+jump jumpPool[JUMP_POOL_SIZE];
+int noOfPoolJumps = 0;
+bool fileInUse(int address);
+void relocateFile(int from, int to);
+void flushBlock();
+void releaseBlock();
+void writeCached(int address, byte value);
+// Processes keep their slot in the table until they stop
+process processTable[PROCESS_TABLE_SIZE];
+// A PID is the generation of its slot followed by the slot number, every
+// process that stops starts a new generation so its PID is not reused soon
+const int SLOT_BITS = 4;  // Enough for PROCESS_TABLE_SIZE
+const int SLOT_MASK = (1 << SLOT_BITS) - 1;
+byte generation[PROCESS_TABLE_SIZE];
+// Ready processes, and waiting processes sorted by release time
+signed char readyHead = -1;
+signed char sleepHead = -1;
+
+// SCHEDULER
+// Stride scheduling: every instruction advances the pass of a process by
+// STRIDE / priority, the ready process with the lowest pass runs next
+const byte MIN_PRIORITY = 1;
+const byte MAX_PRIORITY = 10;
+const byte DEFAULT_PRIORITY = 5;
+const uint16_t STRIDE = 2520;  // Divisible by every priority
+uint16_t globalPass = 0;
+#if EDF_ENABLED
+// Earliest deadline first: ready processes with a deadline run before the
+// others, the deadline of a job is the DELAYUNTIL target it is heading for
+const byte STRIDE_MODE = 0;
+const byte EDF_MODE = 1;
+byte schedulingMode = STRIDE_MODE;
+#endif
+// Program time in ms, millis() continued from the checkpoint after a warm
+// restart, so the times that programs keep stay valid
+uint32_t clockOffset = 0;
+uint32_t programMillis() { return millis() + clockOffset; }
+// A process that runs more instructions than its budget without waiting in
+// DELAYUNTIL, WAITEVENT or WAITUNTILDONE is taken as a runaway and suspended
+uint16_t defaultBudget = INSTRUCTION_BUDGET;
+
+// EVENTS
+// An external interrupt attached with ATTACHEVENT posts events to its process.
+// The ISR only counts them, the scheduler wakes the process waiting in
+// WAITEVENT, so the reaction does not wait for the other processes.
+const int NO_OF_EVENTS = 2;  // INT0 and INT1, on pins 2 and 3 of the Uno
+struct eventSource {
+    int procID;  // Process the interrupt is attached to, -1 if none
+    byte pin;
+    volatile byte pending;  // Events not yet taken by WAITEVENT
+};
+eventSource events[NO_OF_EVENTS];
+
+// WATCHDOG
+// loop() resets the watchdog, if the interpreter hangs in one step the board
+// resets and boots into the checkpoint or the autostart list. Storage and
+// output loops that may take longer reset it too.
+#if WATCHDOG_ENABLED
+const byte WATCHDOG_TIMEOUT = WDTO_2S;
+void feedWatchdog() { wdt_reset(); }
+#else
+void feedWatchdog() {}
+#endif
+
+// STACK
+const int STACKSIZE = 16;
+byte stack[PROCESS_TABLE_SIZE][STACKSIZE] = {0};
+// A FIXED holds a Q16.16 number as a 32-bit integer: 16 bits for the integer
+// part and 16 bits for the fraction
+const int32_t FIXED_ONE = 65536;
+
+#if PROFILING_ENABLED
+// PROFILING
+// Slot 0 counts unknown opcodes, then CHAR to WAITEVENT, then IF onwards
+const int PROFILE_SLOTS = WAITEVENT + 1 + WIDEWHILE - IF + 1;
+unsigned long opcodeCount[PROFILE_SLOTS];
+unsigned long opcodeMicros[PROFILE_SLOTS];
+#endif
+
+void store();
+void retrieve();
+void erase();
+void files();
+void freespace();
+void run();
+void list();
+void suspend();
+void resume();
+void kill();
+void defrag();
+void nice();
+#if EDF_ENABLED
+void sched();
+#endif
+void autostart();
+void checkpoint();
+void budget();
+#if DUMP_ENABLED
+void dump();
+#endif
+#if PROFILING_ENABLED
+void stats();
+#endif
+
+typedef struct {
+    char name[MAX_FILE_NAME_LENGTH];
+    void (*func)();
+    int numberOfArguments;
+    int optionalArguments;
+} commandType;
+
+// The tables of commands and functions are constant, they stay in flash
+static const commandType commandList[] PROGMEM = {
+    {"store", &store, 2}, {"retrieve", &retrieve, 1},   {"erase", &erase, 1},
+    {"files", &files, 0}, {"freespace", &freespace, 0}, {"run", &run, 1, 1},
+    {"list", &list, 0},   {"suspend", &suspend, 1},     {"resume", &resume, 1},
+    {"kill", &kill, 1},   {"nice", &nice, 2},
+    {"defrag", &defrag, 0}, {"autostart", &autostart, 0, 2}, {"checkpoint", &checkpoint, 0, 1},
+    {"budget", &budget, 0, 2},
+#if EDF_ENABLED
+    {"sched", &sched, 0, 1},
+#endif
+#if DUMP_ENABLED
+    {"dump", &dump, 1},
+#endif
+#if PROFILING_ENABLED
+    {"stats", &stats, 0},
+#endif
+};
+
+/*  
+ *  |-----------------------------------------------------------------------------------|
+ *  |                                     STORAGE                                       |
+ *  |-----------------------------------------------------------------------------------|
+ */
+#if SD_ENABLED
+// Write the cached sector back if it has changed
+void sdFlush() {
+    if (sectorDirty && card.writeBlock(cachedSector, sectorCache)) {
+        sectorDirty = false;
+    }
+}
+// Function loads the sector of address into the cache and returns whether it succeeded
+bool cacheSector(int address) {
+    long sector = address / SECTOR_SIZE;
+    if (sector != cachedSector) {
+        sdFlush();
+        if (!card.readBlock(sector, sectorCache)) {
+            cachedSector = -1;
+            return false;
+        }
+        cachedSector = sector;
+    }
+    return true;
+}
+byte sdRead(int address) {
+    return cacheSector(address) ? sectorCache[address % SECTOR_SIZE] : 0;
+}
+void sdUpdate(int address, byte value) {
+    if (cacheSector(address) && sectorCache[address % SECTOR_SIZE] != value) {
+        sectorCache[address % SECTOR_SIZE] = value;
+        sectorDirty = true;
+    }
+}
+const blockDevice storage = {&sdRead, &sdUpdate, &sdFlush, SD_SIZE};
+#else
+byte eepromRead(int address) {
+    return EEPROM.read(address);
+}
+void eepromUpdate(int address, byte value) {
+    EEPROM.update(address, value);
+}
+// The EEPROM is written directly
+void eepromFlush() {}
+const blockDevice storage = {&eepromRead, &eepromUpdate, &eepromFlush, EEPROM.length()};
+#endif
+
+// Read a value from the block device, like EEPROM.get
+template <typename T>
+T& storageGet(int address, T& value) {
+    byte* b = (byte*)&value;
+    for (unsigned int i = 0; i < sizeof(T); i++) {
+        b[i] = storage.read(address + i);
+    }
+    return value;
+}
+// Write a value to the block device, like EEPROM.put
+template <typename T>
+void storagePut(int address, const T& value) {
+    const byte* b = (const byte*)&value;
+    for (unsigned int i = 0; i < sizeof(T); i++) {
+        storage.update(address + i, b[i]);
+    }
+}
+
+/*  
+ *  |-----------------------------------------------------------------------------------|
+ *  |                               Command Line Interface                              |
+ *  |-----------------------------------------------------------------------------------|
+ */
+// Check whether given function is known
+bool checkCommand() {
+    bool foundMatch = false;
+    int commandLength = sizeof(commandList) / sizeof(commandType);
+    // Loop through known commands
+    for (int i = 0; i < commandLength; i++) {
+        commandType command;
+        memcpy_P(&command, &commandList[i], sizeof(command));
+        // Function is known
+        if (strcmp(command.name, buffer[0]) == 0) {
+            // Not enough or too many arguments in call
+            if (argumentCounter < command.numberOfArguments ||
+                argumentCounter > command.numberOfArguments + command.optionalArguments) {
+                Serial.print(command.numberOfArguments);
+                Serial.println(F(" arguments required"));
+            } else {
+                foundMatch = true;
+                // Call function
+                void (*func)() = command.func;
+                func();
+            }
+        }
+    }
+    // Not a known command
+    if (!foundMatch) {
+          Serial.print(F("Command '"));
+          Serial.print(buffer[0]);
+          Serial.println(F("' is not a known command."));
+          Serial.println(F("Available commands:"));
+          for (int i = 0; i < commandLength; i++) {
+            commandType command;
+            memcpy_P(&command, &commandList[i], sizeof(command));
+            Serial.println(command.name);
+          }
+    }
+    return foundMatch;
+}
+// Function that updates input buffer
+void inputCLI() {
+    if (Serial.available() > 0) {
+        delayMicroseconds(1042);
+        int receivedChar = Serial.read();
+
+        if (receivedChar == 32) {
+            // Space pressed, terminate argument and go to next argument in buffer
+            buffer[argumentCounter][bufferCounter] = '\0';
+            argumentCounter++;
+            bufferCounter = 0;
+        } else if (receivedChar == 13 || receivedChar == 10) {
+            // Enter pressed, check command and clear buffer
+            delayMicroseconds(1042);
+            buffer[argumentCounter][bufferCounter] = '\0';
+            Serial.read();
+            checkCommand();
+            storage.flush();
+            for (int i = 0; i < 4; i++) {
+                memset(buffer[i], 0, MAX_FILE_NAME_LENGTH);
+            }
+            bufferCounter = 0;
+            argumentCounter = 0;
+        } else {
+            // Add char to buffer
+            buffer[argumentCounter][bufferCounter] = receivedChar;
+            bufferCounter++;
+        }
+    }
+}
+// Function validates input on numbers
+bool isNumeric(int argument = 1) {
+    for (int i = 0; buffer[argument][i] != '\0'; i++) {
+        if (!isdigit(buffer[argument][i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*  
+ *  |-----------------------------------------------------------------------------------|
+ *  |                                       FAT                                         |
+ *  |-----------------------------------------------------------------------------------|
+ */
+// Function returns the index of the file in FAT, ROM files come after the
+// stored ones
+int getFileInFAT(const char* fileName) {
+    for (int i = 0; i < noOfFiles; i++) {
+        if (strcmp(FAT[i].name, fileName) == 0) {
+            return i;
+        }
+    }
+#if ROM_FILES_ENABLED
+    for (int i = 0; i < NO_OF_ROM_FILES; i++) {
+        if (strcmp_P(fileName, romFiles[i].name) == 0) {
+            return ROM_INDEX + i;
+        }
+    }
+#endif
+    return -1;
+}
+// Function returns the FAT entry of a file index from getFileInFAT
+FATEntry getFile(int fatIndex) {
+#if ROM_FILES_ENABLED
+    if (fatIndex >= ROM_INDEX) {
+        FATEntry entry;
+        memcpy_P(&entry, &romFiles[fatIndex - ROM_INDEX], sizeof(entry));
+        entry.beginPosition += ROM_BASE;
+        return entry;
+    }
+#endif
+    return FAT[fatIndex];
+}
+// Read a byte of a file, ROM files are read from flash
+byte fileRead(int address) {
+#if ROM_FILES_ENABLED
+    if (address >= ROM_BASE) {
+        return pgm_read_byte(romImage + (address - ROM_BASE));
+    }
+#endif
+    return storage.read(address);
+}
+#if !LOG_STRUCTURED_ENABLED
+// Function sets FAT entry on given slot
+void setFATEntry(int slot, const FATEntry& entry) {
+    int address = sizeof(noOfFiles) + (slot * sizeof(FATEntry));
+    storagePut(address, entry);
+}
+// Function that returns FAT entry on slot
+FATEntry getFATEntry(int slot) {
+    FATEntry entry;
+    int address = sizeof(noOfFiles) + (slot * sizeof(FATEntry));
+    storageGet(address, entry);
+    return entry;
+}
+// Function returns the address of the journal, files end before it
+int journalAddress() {
+    return storage.size - JOURNAL_SIZE;
+}
+// Function returns the checksum of a journal record
+byte journalCheck(const journalRecord& record) {
+    const byte* b = (const byte*)&record;
+    byte check = 0x5A + record.slot + lowByte(record.seq) + highByte(record.seq);
+    for (unsigned int i = 0; i < sizeof(record.entry) + sizeof(record.from); i++) {
+        check += b[i];
+    }
+    return check;
+}
+// Store the number of copied chunks of a slide as a Gray code, successive
+// values differ in one bit so a reset never leaves a half written value. The
+// progress is stored at address, behind its journal record.
+void writeProgress(int address, uint16_t chunks) {
+    uint16_t gray = chunks ^ (chunks >> 1);
+    storage.update(address, lowByte(gray));
+    storage.update(address + 1, highByte(gray));
+}
+uint16_t readProgress(int address) {
+    uint16_t gray = word(storage.read(address + 1), storage.read(address));
+    uint16_t chunks = 0;
+    for (; gray != 0; gray >>= 1) {
+        chunks ^= gray;
+    }
+    return chunks;
+}
+// Carry out a journaled FAT update with its slide progress at progress,
+// repeating it is harmless
+void applyJournal(const journalRecord& record, int progress) {
+    int distance = record.from - record.entry.beginPosition;
+    if (record.from != -1 && distance > 0) {
+        // The file slides down in chunks no larger than the distance, so the
+        // source of a chunk is intact until the chunk has been copied
+        int chunks = (record.entry.length + distance - 1) / distance;
+        for (int c = readProgress(progress); c < chunks; c++) {
+            for (int i = c * distance; i < (c + 1) * distance && i < record.entry.length; i++) {
+                storage.update(record.entry.beginPosition + i, storage.read(record.from + i));
+                feedWatchdog();
+            }
+            writeProgress(progress, c + 1);
+        }
+    }
+    setFATEntry(record.slot, record.entry);
+}
+// Update a FAT slot through the journal, optionally sliding the file data down
+// from its old position. After a reset either the old or the new state is found.
+void commitFATEntry(int slot, const FATEntry& entry, int from) {
+    journalRecord record;
+    record.entry = entry;
+    record.from = from;
+    record.slot = slot;
+    record.seq = journalSeq;
+    record.check = journalCheck(record);
+    int address = journalAddress() + journalNext * JOURNAL_RECORD_SIZE;
+    int progress = address + sizeof(journalRecord);
+    // The cached block may hold the FAT slot, the journal or the file
+    releaseBlock();
+    // The record overwritten is the older one, its update is complete
+    if (from != -1) {
+        writeProgress(progress, 0);
+    }
+    storagePut(address, record);
+    // The record has to be stored before the update starts
+    storage.flush();
+    applyJournal(record, progress);
+    storage.flush();
+    journalNext ^= 1;
+    journalSeq++;
+}
+// Finish the last FAT update if a reset interrupted it, the newest valid
+// record is carried out again
+void replayJournal() {
+    journalRecord records[2];
+    bool valid[2];
+    for (int i = 0; i < 2; i++) {
+        storageGet(journalAddress() + i * JOURNAL_RECORD_SIZE, records[i]);
+        valid[i] = records[i].slot < MAX_FILES && records[i].check == journalCheck(records[i]);
+    }
+    int newest = (valid[0] && !(valid[1] && (int16_t)(records[1].seq - records[0].seq) > 0)) ? 0 : 1;
+    journalNext = 0;
+    journalSeq = 0;
+    if (valid[newest]) {
+        int address = journalAddress() + newest * JOURNAL_RECORD_SIZE;
+        applyJournal(records[newest], address + sizeof(journalRecord));
+        journalNext = newest ^ 1;
+        journalSeq = records[newest].seq + 1;
+    }
+}
+// Convert an older layout. The oldest starts with the number of files followed
+// by that many FAT entries, the FAT_MAGIC_V1 layout has the slots of this one
+// and a single journal record, whose update is finished first. Anything else
+// is formatted as an empty file system.
+void migrateFAT(int16_t files) {
+    if (files == FAT_MAGIC_V1) {
+        journalRecord record;
+        int address = storage.size - JOURNAL_V1_SIZE;
+        storageGet(address, record);
+        // The progress follows where the generation is now
+        record.seq = 0;
+        if (record.slot < MAX_FILES && record.check == journalCheck(record)) {
+            applyJournal(record, address + sizeof(journalRecord) - sizeof(record.seq));
+        }
+        files = MAX_FILES;
+    }
+    if (files < 0 || files > MAX_FILES) {
+        files = 0;
+    }
+    for (int slot = 0; slot < MAX_FILES; slot++) {
+        FATEntry entry = getFATEntry(slot);
+        bool keep = slot < files;
+        if (keep && entry.name[0] != '\0' && entry.beginPosition + entry.length > journalAddress()) {
+            Serial.print(F("Error. No room for the journal, file removed: "));
+            Serial.println(entry.name);
+            keep = false;
+        }
+        if (!keep) {
+            // Free the slot
+            storage.update(sizeof(noOfFiles) + slot * sizeof(FATEntry), 0);
+        }
+    }
+    // Neither journal record is valid
+    journalRecord none = {};
+    none.slot = 0xFF;
+    for (int i = 0; i < 2; i++) {
+        storagePut(journalAddress() + i * JOURNAL_RECORD_SIZE, none);
+    }
+    storagePut(0, FAT_MAGIC);
+    storage.flush();
+}
+// Function returns a FAT slot that holds no file
+int freeFATSlot() {
+    for (int slot = 0; slot < MAX_FILES; slot++) {
+        bool used = false;
+        for (int i = 0; i < noOfFiles; i++) {
+            used = used || fatSlot[i] == slot;
+        }
+        if (!used) {
+            return slot;
+        }
+    }
+    return -1;
+}
+// Derive the free extents from the FAT
+void buildFreeExtents() {
+    initExtents(freeExtents, SYSTEM_MEMORY, journalAddress());
+    for (int i = 0; i < noOfFiles; i++) {
+        reserveExtent(freeExtents, FAT[i].beginPosition, FAT[i].length);
+    }
+}
+
+// Read FAT from EEPROM, done once at startup since every change is written
+// through from the copy in RAM
+void readFAT() {
+    int16_t header;
+    storageGet(0, header);
+    if (header != FAT_MAGIC) {
+        migrateFAT(header);
+    }
+    replayJournal();
+    noOfFiles = 0;
+    for (int slot = 0; slot < MAX_FILES; slot++) {
+        FATEntry entry = getFATEntry(slot);
+        if (entry.name[0] != '\0') {
+            FAT[noOfFiles] = entry;
+            fatSlot[noOfFiles] = slot;
+            noOfFiles++;
+        }
+    }
+    buildFreeExtents();
+}
+// Sort the FAT entries by position
+void sortFAT() {
+    bool sorted = false;
+    while (!sorted) {
+        sorted = true;
+        for (int i = 0; i < noOfFiles - 1; i++) {
+            if (FAT[i].beginPosition > FAT[i + 1].beginPosition) {
+                // Swap the entries
+                FATEntry temp = FAT[i];
+                FAT[i] = FAT[i + 1];
+                FAT[i + 1] = temp;
+                byte slot = fatSlot[i];
+                fatSlot[i] = fatSlot[i + 1];
+                fatSlot[i + 1] = slot;
+                sorted = false;
+            }
+        }
+    }
+}
+// Slide a file down to position, the processes using it follow
+void moveFile(int fatIndex, int position) {
+    int from = FAT[fatIndex].beginPosition;
+    FAT[fatIndex].beginPosition = position;
+    // The journal makes the copy resumable after a reset
+    commitFATEntry(fatSlot[fatIndex], FAT[fatIndex], from);
+    relocateFile(from, position);
+}
+// Slide files down to coalesce the free space behind them. With a fileSize
+// only the fewest files needed for a free block of that size are moved,
+// without one all files are packed.
+// Function returns the number of moved files, or -1 if there is not enough space
+int compactFiles(int fileSize) {
+    sortFAT();
+    int first = 0;
+    if (fileSize > 0) {
+        // Find the last file from which on packing leaves enough space at the end
+        int tailLength = 0;
+        first = -1;
+        for (int i = noOfFiles - 1; i >= 0 && first == -1; i--) {
+            tailLength += FAT[i].length;
+            int start = (i == 0) ? SYSTEM_MEMORY : FAT[i - 1].beginPosition + FAT[i - 1].length;
+            if (journalAddress() - start - tailLength >= fileSize) {
+                first = i;
+            }
+        }
+        if (first == -1) {
+            return -1;
+        }
+    }
+    // The cached block may belong to a file that moves
+    releaseBlock();
+
+    int position = (first == 0) ? SYSTEM_MEMORY : FAT[first - 1].beginPosition + FAT[first - 1].length;
+    int moved = 0;
+    for (int i = first; i < noOfFiles; i++) {
+        if (FAT[i].beginPosition != position) {
+            moveFile(i, position);
+            moved++;
+        }
+        position += FAT[i].length;
+    }
+    buildFreeExtents();
+    return moved;
+}
+
+// Function stores a new file and returns its position, or -1 if there is no space
+int addFile(const char* filename, int fileSize, const char* data) {
+    // Take the smallest free extent that fits, the free space is coalesced
+    // when none is large enough
+    int position = allocateExtent(freeExtents, fileSize);
+    if (position == -1 && compactFiles(fileSize) != -1) {
+        position = allocateExtent(freeExtents, fileSize);
+    }
+    if (position == -1) {
+        return -1;
+    }
+
+    // Write the data before the FAT entry, so a reset never leaves a file
+    // without its data. The cached block may overlap the new file.
+    releaseBlock();
+    if (data != NULL) {
+        for (int i = 0; i < fileSize; i++) {
+            storage.update(position + i, data[i]);
+        }
+    }
+
+    // Make new FATEntry with new data
+    FATEntry file = {};
+    strcpy(file.name, filename);
+    file.beginPosition = position;
+    file.length = fileSize;
+
+    // Write the FAT entry to the EEPROM
+    int slot = freeFATSlot();
+    commitFATEntry(slot, file, -1);
+    FAT[noOfFiles] = file;
+    fatSlot[noOfFiles] = slot;
+    noOfFiles++;
+    return position;
+}
+// Remove a file from the FAT, its space becomes free
+void removeFile(int fatIndex) {
+    releaseBlock();
+    releaseExtent(freeExtents, FAT[fatIndex].beginPosition, FAT[fatIndex].length);
+    // Free the slot of the file
+    FATEntry emptyEntry = {};
+    commitFATEntry(fatSlot[fatIndex], emptyEntry, -1);
+    // Move other entries to the left
+    for (int i = fatIndex; i < noOfFiles - 1; i++) {
+        FAT[i] = FAT[i + 1];
+        fatSlot[i] = fatSlot[i + 1];
+    }
+    noOfFiles--;
+}
+// Give a file another name through the journal. Function returns whether it
+// succeeded.
+bool renameFile(int fatIndex, const char* fileName) {
+    FATEntry file = FAT[fatIndex];
+    strcpy(file.name, fileName);
+    commitFATEntry(fatSlot[fatIndex], file, -1);
+    FAT[fatIndex] = file;
+    return true;
+}
+// Function returns the space left for files
+int freeBytes() {
+    int usedSpace = 0;
+    for (int i = 0; i < noOfFiles; i++) {
+        usedSpace += FAT[i].length;
+    }
+    return journalAddress() - SYSTEM_MEMORY - usedSpace;
+}
+#else
+// Function returns the checksum of a log record header
+uint16_t headerCheck(const logHeader& header) {
+    const byte* b = (const byte*)&header;
+    byte sum1 = 0;
+    byte sum2 = 0;
+    for (unsigned int i = sizeof(header.live); i < sizeof(header) - sizeof(header.check); i++) {
+        sum1 = (sum1 + b[i]) % 255;
+        sum2 = (sum2 + sum1) % 255;
+    }
+    return word(sum2, sum1);
+}
+// Function reads the header at address and returns whether it starts a record
+bool readHeader(int address, logHeader& header) {
+    if (address < 0 || address + HEADER_SIZE > storage.size) {
+        return false;
+    }
+    storageGet(address, header);
+    return header.signature == LOG_SIGNATURE && header.check == headerCheck(header) &&
+           header.length >= 0 && header.length <= storage.size - HEADER_SIZE - address &&
+           memchr(header.name, '\0', sizeof(header.name)) != NULL;
+}
+// Function returns the position of the record after the one at address. A
+// record that did not fit before the end of the EEPROM was written at 0.
+int nextRecord(int address) {
+    logHeader header;
+    logHeader next;
+    readHeader(address, header);
+    int position = address + HEADER_SIZE + header.length;
+    if (position != logHead && !(readHeader(position, next) && next.seq == (int16_t)(header.seq + 1))) {
+        position = 0;
+    }
+    return position;
+}
+// Function returns where a record of size bytes can be written without
+// touching the records between tail and head, or -1 if there is no room
+int fitBetween(int head, int tail, int size) {
+    if (head >= tail) {
+        if (storage.size - head >= size) {
+            return head;
+        }
+        // Wrap around, the head may not run into the tail of a log that is not empty
+        return (tail > size || head == tail) ? 0 : -1;
+    }
+    return (tail - head > size) ? head : -1;
+}
+// Function returns where the next record of size bytes can be written, or -1
+int fitPosition(int size) {
+    return fitBetween(logHead, logTail, size);
+}
+// Write a record at position. The data is copied from data or from the EEPROM
+// at from, with neither the bytes are left as they are.
+void writeRecord(int position, const char* name, int length, const char* data, int from) {
+    if (position < logHead) {
+        // Stale headers in the skipped end of the EEPROM could outlive the
+        // sequence numbers, so they are invalidated
+        logHeader stale;
+        for (int i = logHead; i + HEADER_SIZE <= storage.size; i++) {
+            if (readHeader(i, stale)) {
+                storage.update(i + 1, 0);
+            }
+        }
+    }
+    int address = position + HEADER_SIZE;
+    for (int i = 0; i < length; i++) {
+        if (data != NULL) {
+            storage.update(address + i, data[i]);
+        } else if (from != -1) {
+            storage.update(address + i, storage.read(from + i));
+        }
+        feedWatchdog();
+    }
+    logHeader header = {};
+    header.live = LOG_LIVE;
+    header.signature = LOG_SIGNATURE;
+    header.seq = logSeq++;
+    header.length = length;
+    strcpy(header.name, name);
+    header.check = headerCheck(header);
+    // The header is written last, a reset before leaves no record
+    storagePut(position, header);
+    if (logHead == logTail) {
+        // The log was empty
+        logTail = position;
+    }
+    logHead = address + length;
+}
+// Reclaim the oldest record, a live one is appended to the log again first.
+// Function returns false if there is no room to move it.
+bool reclaimRecord() {
+    logHeader header;
+    readHeader(logTail, header);
+    if (header.live == LOG_LIVE) {
+        int position = fitPosition(HEADER_SIZE + header.length);
+        if (position == -1) {
+            return false;
+        }
+        // The cached block may belong to the file
+        releaseBlock();
+        int from = logTail + HEADER_SIZE;
+        writeRecord(position, header.name, header.length, NULL, from);
+        // A reset before the old copy is erased leaves two, the newest is kept
+        storage.update(logTail, 0);
+        FAT[getFileInFAT(header.name)].beginPosition = position + HEADER_SIZE;
+        relocateFile(from, position + HEADER_SIZE);
+    }
+    logTail = nextRecord(logTail);
+    return true;
+}
+// Function returns the position of the record before the one at address, the
+// newest record is the one before logHead
+int previousRecord(int address) {
+    int position = logTail;
+    for (int i = 0; i < MAX_RECORDS; i++) {
+        int next = nextRecord(position);
+        if (next == address) {
+            return position;
+        }
+        position = next;
+    }
+    return -1;
+}
+// Give the space of an erased newest record back to the head of the log, its
+// sequence number is taken again. Function returns false if the newest record
+// is live or also the oldest.
+bool reclaimHead() {
+    logHeader header;
+    logHeader last;
+    int newest = (logHead == logTail) ? -1 : previousRecord(logHead);
+    if (newest == -1 || newest == logTail || !readHeader(newest, header) || header.live == LOG_LIVE) {
+        return false;
+    }
+    int previous = previousRecord(newest);
+    if (previous == -1 || !readHeader(previous, last)) {
+        return false;
+    }
+    // The header is invalidated first, a reset leaves the previous record newest
+    storage.update(newest + 1, 0);
+    logHead = previous + HEADER_SIZE + last.length;
+    logSeq = last.seq + 1;
+    return true;
+}
+// Function returns the number of erased records between tail and head
+int erasedRecords() {
+    int erased = 0;
+    logHeader header;
+    for (int position = logTail, i = 0; position != logHead && i < MAX_RECORDS; position = nextRecord(position), i++) {
+        if (readHeader(position, header) && header.live != LOG_LIVE) {
+            erased++;
+        }
+    }
+    return erased;
+}
+
+// Rebuild the FAT from the log, done once at startup. Every valid header is a
+// candidate, newest first; one overlapping a newer record has been overwritten.
+// The oldest live record is the tail, older records are free space.
+void readFAT() {
+    int16_t positions[MAX_RECORDS];
+    int16_t ages[MAX_RECORDS];
+    int records = 0;
+    logHeader header;
+    for (int i = 0; i + HEADER_SIZE <= storage.size && records < MAX_RECORDS; i++) {
+        if (readHeader(i, header)) {
+            positions[records] = i;
+            ages[records] = header.seq;
+            records++;
+        }
+    }
+    // The newest record has no record with a higher sequence number
+    int16_t newest = 0;
+    for (int i = 0; i < records; i++) {
+        bool isNewest = true;
+        for (int j = 0; j < records; j++) {
+            isNewest = isNewest && (int16_t)(ages[j] - ages[i]) <= 0;
+        }
+        if (isNewest) {
+            newest = ages[i];
+        }
+    }
+    // Sort the candidates by age
+    for (int i = 0; i < records; i++) {
+        ages[i] = newest - ages[i];
+        for (int j = i; j > 0 && ages[j] < ages[j - 1]; j--) {
+            int16_t temp = ages[j];
+            ages[j] = ages[j - 1];
+            ages[j - 1] = temp;
+            temp = positions[j];
+            positions[j] = positions[j - 1];
+            positions[j - 1] = temp;
+        }
+    }
+
+    noOfFiles = 0;
+    logHead = 0;
+    logTail = 0;
+    logSeq = newest + 1;
+    int accepted = 0;
+    for (int i = 0; i < records; i++) {
+        readHeader(positions[i], header);
+        int end = positions[i] + HEADER_SIZE + header.length;
+        bool overwritten = false;
+        for (int j = 0; j < accepted; j++) {
+            logHeader other;
+            readHeader(positions[j], other);
+            overwritten = overwritten ||
+                          (positions[i] < positions[j] + HEADER_SIZE + other.length && positions[j] < end);
+        }
+        if (overwritten) {
+            continue;
+        }
+        positions[accepted++] = positions[i];
+        if (accepted == 1) {
+            logHead = end;
+            logTail = end;
+        }
+        if (header.live != LOG_LIVE) {
+            continue;
+        }
+        if (getFileInFAT(header.name) != -1 || noOfFiles >= MAX_FILES) {
+            // An older copy of a file that was moved
+            storage.update(positions[i], 0);
+            continue;
+        }
+        FATEntry file = {};
+        strcpy(file.name, header.name);
+        file.beginPosition = positions[i] + HEADER_SIZE;
+        file.length = header.length;
+        FAT[noOfFiles++] = file;
+        logTail = positions[i];
+    }
+}
+// Reclaim records until a file of fileSize bytes fits at the head. Erased
+// records at the tail and at the head are dropped, a live record at the tail
+// is appended again. Without a fileSize all erased records are dropped.
+// Function returns the number of moved files, or -1 if there is not enough space
+int compactFiles(int fileSize) {
+    int moved = 0;
+    logHeader header;
+    for (int i = 0; i <= 2 * MAX_RECORDS; i++) {
+        if (fileSize > 0 ? fitPosition(HEADER_SIZE + fileSize) != -1 : erasedRecords() == 0) {
+            return moved;
+        }
+        readHeader(logTail, header);
+        if (header.live == LOG_LIVE && reclaimHead()) {
+            continue;
+        }
+        if (!reclaimRecord()) {
+            break;
+        }
+        if (header.live == LOG_LIVE) {
+            moved++;
+        }
+    }
+    return (fileSize > 0) ? -1 : moved;
+}
+// Function returns the largest record that fits between head and tail
+int roomBetween(int head, int tail) {
+    if (head == tail) {
+        return storage.size - 1;
+    }
+    if (head > tail) {
+        return max(storage.size - head, tail - 1);
+    }
+    return tail - head - 1;
+}
+// Function returns the space left for files: the largest file that fits at
+// some point while compactFiles reclaims one round of records. The records
+// are only read, a live one is placed where compactFiles would append it.
+int freeBytes() {
+    int head = logHead;
+    int tail = logTail;
+    int largest = roomBetween(head, tail);
+    logHeader header;
+    // Erased records at the tail are dropped first
+    for (int i = 0; tail != head && i < MAX_RECORDS && readHeader(tail, header) && header.live != LOG_LIVE; i++) {
+        tail = nextRecord(tail);
+    }
+    // Then the erased records at the head, up to the newest live one
+    int newest = -1;
+    for (int position = tail, i = 0; position != logHead && i < MAX_RECORDS; position = nextRecord(position), i++) {
+        if (readHeader(position, header) && header.live == LOG_LIVE) {
+            newest = position;
+            head = position + HEADER_SIZE + header.length;
+        }
+    }
+    if (newest == -1) {
+        // Only erased records are left
+        return storage.size - 1 - HEADER_SIZE;
+    }
+    largest = max(largest, roomBetween(head, tail));
+    // Then every live record at the tail is appended again, until one does not fit
+    int first = -1;
+    for (int i = 0; i < MAX_RECORDS; i++) {
+        readHeader(tail, header);
+        int next = (tail == newest) ? -1 : nextRecord(tail);
+        if (header.live == LOG_LIVE) {
+            int position = fitBetween(head, tail, HEADER_SIZE + header.length);
+            if (position == -1) {
+                break;
+            }
+            head = position + HEADER_SIZE + header.length;
+            if (first == -1) {
+                first = position;
+            }
+        }
+        // After the newest record the log starts at the first appended one
+        tail = (next == -1) ? first : next;
+        largest = max(largest, roomBetween(head, tail));
+        if (next == -1) {
+            break;
+        }
+    }
+    return max(largest - HEADER_SIZE, 0);
+}
+// Function appends a new file to the log and returns its position, or -1 if
+// there is no space
+int addFile(const char* filename, int fileSize, const char* data) {
+    int size = HEADER_SIZE + fileSize;
+    if (size > freeBytes() + HEADER_SIZE) {
+        return -1;
+    }
+    int position = fitPosition(size);
+    if (position == -1 && compactFiles(fileSize) != -1) {
+        position = fitPosition(size);
+    }
+    if (position == -1) {
+        return -1;
+    }
+    // The cached block may overlap the new record
+    releaseBlock();
+    writeRecord(position, filename, fileSize, data, -1);
+
+    FATEntry file = {};
+    strcpy(file.name, filename);
+    file.beginPosition = position + HEADER_SIZE;
+    file.length = fileSize;
+    FAT[noOfFiles] = file;
+    noOfFiles++;
+    return file.beginPosition;
+}
+// Erase a file by clearing the live flag of its record
+void removeFile(int fatIndex) {
+    releaseBlock();
+    storage.update(FAT[fatIndex].beginPosition - HEADER_SIZE, 0);
+    // Move other entries to the left
+    for (int i = fatIndex; i < noOfFiles - 1; i++) {
+        FAT[i] = FAT[i + 1];
+    }
+    noOfFiles--;
+}
+// Give a file another name by appending a copy of its record under that name.
+// A reset before the old record is erased leaves both. Function returns false
+// if there is no room for the copy.
+bool renameFile(int fatIndex, const char* fileName) {
+    int size = HEADER_SIZE + FAT[fatIndex].length;
+    int position = fitPosition(size);
+    if (position == -1 && compactFiles(FAT[fatIndex].length) != -1) {
+        position = fitPosition(size);
+    }
+    if (position == -1) {
+        return false;
+    }
+    // Compacting may have moved the file, the cached block may overlap the copy
+    FATEntry file = FAT[fatIndex];
+    releaseBlock();
+    writeRecord(position, fileName, file.length, NULL, file.beginPosition);
+    storage.update(file.beginPosition - HEADER_SIZE, 0);
+    strcpy(FAT[fatIndex].name, fileName);
+    FAT[fatIndex].beginPosition = position + HEADER_SIZE;
+    relocateFile(file.beginPosition, position + HEADER_SIZE);
+    return true;
+}
+#endif
+// Function creates a file with the given data, or an empty one if data is
+// NULL, and returns its position, or -1 on failure
+int createFile(const char* filename, int fileSize, const char* data) {
+    if (noOfFiles >= MAX_FILES) {
+        Serial.println(F("File cannot be stored, limit reached."));
+        return -1;
+    }
+    if (getFileInFAT(filename) != -1) {
+        Serial.println(F("File cannot be stored, given name already exists."));
+        return -1;
+    }
+    int position = addFile(filename, fileSize, data);
+    if (position == -1) {
+        Serial.println(F("Error: No space left for file."));
+        return -1;
+    }
+    return position;
+}
+// Function s file. The file is created before the data arrives, the bytes
+// go through the block cache into it, so the file is never held in RAM.
+void storeFile(const char* filename, int fileSize) {
+    Serial.println(F("Give input for file:"));
+    int position = createFile(filename, fileSize, NULL);
+    // Wait for data
+    while (Serial.available() == 0) {
+        feedWatchdog();
+    }
+
+    for (int i = 0; i < fileSize; i++) {
+        unsigned long start = micros();
+        // Missing bytes are filled with spaces
+        byte value = (Serial.available() != 0) ? Serial.read() : 32;
+        if (position != -1) {
+            writeCached(position + i, value);
+        }
+        // A byte takes 1042 us at 9600 baud, the time spent writing counts.
+        // An EEPROM write takes longer, the receive buffer holds the backlog.
+        unsigned long elapsed = micros() - start;
+        if (elapsed < 1042) {
+            delayMicroseconds(1042 - elapsed);
+        }
+        // About 1900 bytes take longer than the watchdog timeout
+        feedWatchdog();
+    }
+    flushBlock();
+
+    // Clear Serial buffer
+    while (Serial.available()) {
+        Serial.read();
+        delayMicroseconds(1042);
+        feedWatchdog();
+    }
+    if (position == -1) {
+        return;
+    }
+    Serial.println(F("File has been stored."));
+}
+
+// Function to retrieve and print a file from the file system
+void retrieveFile(const char* filename) {
+    // Check if file exists
+    int fatIndex = getFileInFAT(filename);
+    if (fatIndex == -1) {
+        Serial.println(F("File not found."));
+        return;
+    }
+
+    FATEntry file = getFile(fatIndex);
+    int fileIndex = file.beginPosition;
+    // Files written by processes may still be in the block cache
+    flushBlock();
+
+    Serial.print(F("\nContent: "));
+    for (int i = 0; i < file.length; i++) {
+        Serial.print((char)fileRead(fileIndex));
+        fileIndex++;
+        feedWatchdog();
+    }
+    Serial.print(F("\n"));
+    Serial.println(F("End of File Content."));
+}
+// Function erases file
+void eraseFile(const char* fileName) {
+    int fatIndex = getFileInFAT(fileName);
+    if (fatIndex == -1) {
+        Serial.println(F("File not found."));
+        return;
+    }
+#if ROM_FILES_ENABLED
+    if (fatIndex >= ROM_INDEX) {
+        Serial.println(F("Error. ROM files are read-only."));
+        return;
+    }
+#endif
+    // Running processes share the jump table of their file
+    if (fileInUse(FAT[fatIndex].beginPosition)) {
+        Serial.println(F("Error. File is in use by a process."));
+        return;
+    }
+    removeFile(fatIndex);
+
+    Serial.print(F("Erased: "));
+    Serial.println(fileName);
+}
+// Function returns the available free space
+void freespaceEEPROM() {
+    int totalAvailable = freeBytes();
+    Serial.print(F("Available space: "));
+    Serial.println(totalAvailable);
+}
+// Pack all files behind the FAT
+void defragEEPROM() {
+    int moved = compactFiles(0);
+    Serial.print(F("Defragmented, files moved: "));
+    Serial.println(moved);
+}
+// Print one line of the file list
+void printFileEntry(int number, const FATEntry& file) {
+    Serial.print(F("File "));
+    Serial.print(number);
+    Serial.print(F(": Name="));
+    Serial.print(file.name);
+    Serial.print(F("     \tAddress = "));
+    Serial.print(file.beginPosition);
+    Serial.print(F("\tLength = "));
+    Serial.print(file.length);
+    if (file.beginPosition >= ROM_BASE) {
+        Serial.print(F("\tROM"));
+    }
+    Serial.println();
+}
+// Print FAT, followed by the ROM files
+void printFAT() {
+    int total = noOfFiles;
+#if ROM_FILES_ENABLED
+    total += NO_OF_ROM_FILES;
+#endif
+    Serial.println();
+    Serial.print(total);
+    Serial.println(F(" files found"));
+
+    for (int i = 0; i < noOfFiles; i++) {
+        printFileEntry(i, FAT[i]);
+    }
+#if ROM_FILES_ENABLED
+    for (int i = 0; i < NO_OF_ROM_FILES; i++) {
+        printFileEntry(noOfFiles + i, getFile(ROM_INDEX + i));
+    }
+#endif
+    Serial.println();
+}
+// Clear EEPROM
+void clearEeprom() {
+    for (int i = 0; i < storage.size; i++) {
+        storage.update(i, 0);
+        feedWatchdog();
+    }
+    Serial.println(F("\nEEPROM CLEARED\n"));
+}
+
+/*  
+ *  |-----------------------------------------------------------------------------------|
+ *  |                                     FILE I/O                                      |
+ *  |-----------------------------------------------------------------------------------|
+ */
+// Write the bytes of the cached block that files have written back
+void flushBlock() {
+    for (int i = 0; dirtyBytes != 0 && i < BLOCK_SIZE; i++) {
+        if (dirtyBytes & (1 << i)) {
+            storage.update(blockAddress + i, blockCache[i]);
+        }
+    }
+    dirtyBytes = 0;
+}
+// Flush and drop the cached block, before the storage is written directly
+void releaseBlock() {
+    flushBlock();
+    blockAddress = -1;
+}
+// Function returns the cache index of an address, loading its block if needed
+int cacheBlock(int address) {
+    int start = address - address % BLOCK_SIZE;
+    if (start != blockAddress) {
+        flushBlock();
+        blockAddress = start;
+        for (int i = 0; i < BLOCK_SIZE && start + i < storage.size; i++) {
+            blockCache[i] = storage.read(start + i);
+        }
+    }
+    return address - start;
+}
+byte readCached(int address) {
+    if (address >= ROM_BASE) {
+        return fileRead(address);
+    }
+    return blockCache[cacheBlock(address)];
+}
+void writeCached(int address, byte value) {
+    int i = cacheBlock(address);
+    blockCache[i] = value;
+    dirtyBytes |= 1 << i;
+}
+
+// Open a file for a process, the file is created if it does not exist
+void openFile(process& proc, const char* fileName, int fileSize) {
+    proc.fileAddress = -1;
+    int fileIndex = getFileInFAT(fileName);
+    if (fileIndex != -1) {
+        FATEntry file = getFile(fileIndex);
+        proc.fileAddress = file.beginPosition;
+        proc.fileLength = file.length;
+    } else if (fileSize > 0 && strlen(fileName) < MAX_FILE_NAME_LENGTH) {
+        proc.fileAddress = createFile(fileName, fileSize, NULL);
+        proc.fileLength = fileSize;
+    }
+    if (proc.fileAddress == -1) {
+        Serial.println(F("Error. File cannot be opened."));
+    }
+    proc.filePosition = 0;
+}
+// Close the file of a process
+void closeFile(process& proc) {
+    if (proc.fileAddress != -1) {
+        flushBlock();
+        storage.flush();
+        proc.fileAddress = -1;
+    }
+}
+// Function returns whether count bytes can be read or written at the file position
+bool checkFile(process& proc, int count) {
+    if (proc.fileAddress == -1) {
+        Serial.println(F("Error. No file opened."));
+        return false;
+    }
+    if (proc.filePosition + count > proc.fileLength) {
+        Serial.println(F("Error. End of file reached."));
+        return false;
+    }
+    return true;
+}
+// Write bytes at the file position, they go to the EEPROM when the block is flushed
+void writeFile(process& proc, const byte* data, int count) {
+    if (proc.fileAddress >= ROM_BASE) {
+        Serial.println(F("Error. ROM files are read-only."));
+        return;
+    }
+    if (checkFile(proc, count)) {
+        for (int i = 0; i < count; i++) {
+            writeCached(proc.fileAddress + proc.filePosition++, data[i]);
+        }
+    }
+}
+// Function reads bytes from the file position, returns false if there are not enough
+bool readFile(process& proc, byte* data, int count) {
+    if (!checkFile(proc, count)) {
+        return false;
+    }
+    for (int i = 0; i < count; i++) {
+        data[i] = readCached(proc.fileAddress + proc.filePosition++);
+    }
+    return true;
+}
+
+/*  
+ *  |-----------------------------------------------------------------------------------|
+ *  |                                       STACK                                       |
+ *  |-----------------------------------------------------------------------------------|
+ */
+// Function returns the process table slot of a PID
+int pidSlot(int procID) { return procID & SLOT_MASK; }
+
+void pushByte(int procID, int& sp, byte b) { stack[pidSlot(procID)][sp++] = b; }
+byte popByte(int procID, int& sp) {
+    return stack[pidSlot(procID)][--sp];
+}
+
+void pushChar(int procID, int& sp, char c) {
+    pushByte(procID, sp, c);
+    // Push char
+    pushByte(procID, sp, 0x01);
+}
+char popChar(int procID, int& sp) {
+    return popByte(procID, sp);
+}
+
+void pushInt(int procID, int& sp, int i) {
+    pushByte(procID, sp, highByte(i));
+    pushByte(procID, sp, lowByte(i));
+    // Push int
+    pushByte(procID, sp, 0x02);
+}
+int popInt(int procID, int& sp) {
+    byte lb = popByte(procID, sp);
+    byte hb = popByte(procID, sp);
+    int i = (int16_t)word(hb, lb);
+    return i;
+}
+
+void pushFloat(int procID, int& sp, float f) {
+    byte* b = (byte*)&f;
+    for (int i = 3; i >= 0; i--) {
+        // Push bytes beginning with highbytes
+        pushByte(procID, sp, b[i]);
+    }
+    // Push float
+    pushByte(procID, sp, 0x04);
+}
+float popFloat(int procID, int& sp) {
+    byte b[4];
+    for (int i = 0; i < 4; i++) {
+        // Pop bytes beginning with lowbytes
+        byte temp = popByte(procID, sp);
+        b[i] = temp;
+    }
+
+    float* f = (float*)b;
+    return *f;
+}
+
+// Push a 32-bit value, a FIXED is pushed the same way with its own type
+void pushLong(int procID, int& sp, int32_t l, byte type = LONG) {
+    for (int i = 24; i >= 0; i -= 8) {
+        // Push bytes beginning with highbytes
+        pushByte(procID, sp, l >> i);
+    }
+    // Push long
+    pushByte(procID, sp, type);
+}
+int32_t popLong(int procID, int& sp) {
+    uint32_t l = 0;
+    for (int i = 0; i < 32; i += 8) {
+        // Pop bytes beginning with lowbytes
+        l |= (uint32_t)popByte(procID, sp) << i;
+    }
+    return l;
+}
+
+// Function returns the number of bytes of a value of a type, besides STRING
+int typeSize(int type) {
+    if (type == STRINGREF) {
+        return 3;
+    }
+    return (type == FLOAT || type == LONG || type == FIXED) ? 4 : type;
+}
+
+void pushString(int procID, int& sp, char* s) {
+    for (int i = 0; i < strlen(s); i++) {
+        pushByte(procID, sp, s[i]);
+    }
+    // Push terminating zero
+    pushByte(procID, sp, 0x00);
+    // Push length
+    pushByte(procID, sp, strlen(s) + 1);
+    // Push string
+    pushByte(procID, sp, 0x03);
+}
+// Pop a string of size bytes, including the terminating zero, into s
+char* popString(int procID, int& sp, int size, char* s) {
+    for (int i = size - 1; i >= 0; i--) {
+        byte letter = popByte(procID, sp);
+        s[i] = letter;
+    }
+    return s;
+}
+// A STRINGREF is a handle to a string in the constant pool of the running
+// file: its offset in the file and its size including the terminating zero.
+// The offset is relative to the file, so the handle survives defrag.
+struct stringRef {
+    int offset;
+    byte size;
+};
+void pushStringRef(int procID, int& sp, stringRef s) {
+    pushByte(procID, sp, highByte(s.offset));
+    pushByte(procID, sp, lowByte(s.offset));
+    pushByte(procID, sp, s.size);
+    pushByte(procID, sp, STRINGREF);
+}
+stringRef popStringRef(int procID, int& sp) {
+    stringRef s;
+    s.size = popByte(procID, sp);
+    byte lb = popByte(procID, sp);
+    byte hb = popByte(procID, sp);
+    s.offset = word(hb, lb);
+    return s;
+}
+// Pop a STRING or STRINGREF of type into s, which holds capacity bytes; the
+// file at address is the one the STRINGREF points into
+char* popText(int procID, int& sp, int type, int address, char* s, int capacity) {
+    s[0] = '\0';
+    if (type == STRING) {
+        popString(procID, sp, popByte(procID, sp), s);
+    } else if (type == STRINGREF) {
+        stringRef ref = popStringRef(procID, sp);
+        int i = 0;
+        for (; i < capacity - 1 && i < ref.size - 1; i++) {
+            s[i] = fileRead(address + ref.offset + i);
+        }
+        s[i] = '\0';
+    } else {
+        sp -= typeSize(type);
+    }
+    return s;
+}
+
+float popVal(int procID, int& sp, int type) {
+    switch (type) {
+        // Char
+        case 1:
+        {
+            return popChar(procID, sp);
+            break;
+        }
+        // Int
+        case 2:
+        {
+            return popInt(procID, sp);
+            break;
+        }
+        // Float
+        case 4:
+        {
+            return popFloat(procID, sp);
+            break;
+        }
+        case LONG:
+            return popLong(procID, sp);
+        case FIXED:
+            return (float)popLong(procID, sp) / FIXED_ONE;
+        default:
+            break;
+    }
+    return 0;
+}
+
+// A numeric value popped from the stack. CHAR, INT and LONG values are kept
+// as a 32-bit integer, so they are computed without going through float. A
+// FIXED keeps its Q16.16 representation.
+struct number {
+    int type;
+    int32_t l;
+    float f;
+};
+number popNumber(int procID, int& sp) {
+    number n = {popByte(procID, sp), 0, 0};
+    if (n.type == FLOAT) {
+        n.f = popFloat(procID, sp);
+    } else if (n.type == STRING) {
+        // Strings have no value
+        sp -= popByte(procID, sp);
+    } else if (n.type == STRINGREF) {
+        sp -= typeSize(STRINGREF);
+    } else {
+        n.l = (n.type == LONG || n.type == FIXED) ? popLong(procID, sp) : (int32_t)popVal(procID, sp, n.type);
+    }
+    return n;
+}
+float toFloat(const number& n) {
+    if (n.type == FIXED) {
+        return (float)n.l / FIXED_ONE;
+    }
+    return (n.type == FLOAT) ? n.f : n.l;
+}
+int32_t toLong(const number& n) {
+    if (n.type == FIXED) {
+        return n.l / FIXED_ONE;
+    }
+    return (n.type == FLOAT) ? (int32_t)n.f : n.l;
+}
+int32_t toFixed(const number& n) {
+    if (n.type == FIXED) {
+        return n.l;
+    }
+    if (n.type == FLOAT) {
+        return n.f * FIXED_ONE + ((n.f < 0) ? -0.5 : 0.5);
+    }
+    return (uint32_t)n.l << 16;
+}
+// Function returns a value as the integer that represents it in a type of
+// the integer kernels: LONG for CHAR, INT and LONG, or FIXED
+int32_t toKernel(const number& n, int type) {
+    return (type == FIXED) ? toFixed(n) : toLong(n);
+}
+// Push a value as CHAR, INT or LONG, or the representation of a FIXED
+void pushIntegral(int procID, int& sp, int type, int32_t value) {
+    switch (type) {
+        case CHAR:
+            pushChar(procID, sp, value);
+            break;
+        case INT:
+            pushInt(procID, sp, value);
+            break;
+        default:
+            pushLong(procID, sp, value, (type == FIXED) ? FIXED : LONG);
+            break;
+    }
+}
+// Function returns the type of the result of arithmetic on two types: the
+// widest of CHAR, INT, LONG, FIXED and FLOAT
+int resultType(int typeX, int typeY) {
+    if (typeX == FLOAT || typeY == FLOAT) {
+        return FLOAT;
+    }
+    if (typeX == FIXED || typeY == FIXED) {
+        return FIXED;
+    }
+    if (typeX == LONG || typeY == LONG) {
+        return LONG;
+    }
+    return max(typeX, typeY);
+}
+// Print a FIXED with five decimals, like a FLOAT, without float arithmetic
+void printFixed(int32_t f) {
+    uint32_t value = f;
+    if (f < 0) {
+        Serial.print('-');
+        value = -value;
+    }
+    // Fraction in 100000ths, rounded: 100000 / 65536 = 3125 / 2048
+    uint32_t fraction = ((value & 0xFFFF) * 3125 + 1024) >> 11;
+    uint32_t integer = value >> 16;
+    if (fraction == 100000) {
+        integer++;
+        fraction = 0;
+    }
+    Serial.print(integer);
+    Serial.print('.');
+    for (uint32_t digit = 10000; digit > 0; digit /= 10) {
+        Serial.print((char)('0' + fraction / digit % 10));
+    }
+}
+// Pop a value of any type and return whether it is non-zero
+bool popCondition(int procID, int& sp) {
+    int type = popByte(procID, sp);
+    if (type == STRING || type == STRINGREF) {
+        // Strings always count as true
+        sp -= (type == STRING) ? popByte(procID, sp) : typeSize(STRINGREF);
+        return true;
+    }
+    return popVal(procID, sp, type) != 0;
+}
+// Return whether the value on top of the stack is non-zero, leaving it there
+bool peekCondition(int procID, int sp) {
+    return popCondition(procID, sp);
+}
+
+/*  
+ *  |-----------------------------------------------------------------------------------|
+ *  |                                       MEMORY                                      |
+ *  |-----------------------------------------------------------------------------------|
+ */
+// Save char to memory
+void saveChar(char c, int adress) { RAM[adress] = c; }
+// Load char from memory
+char loadChar(int adress) { return RAM[adress]; }
+// Save int to memory
+void saveInt(int i, int adress) {
+    RAM[adress] = highByte(i);
+    RAM[adress + 1] = lowByte(i);
+}
+// Load int from memory
+int loadInt(int adress) {
+    byte hb = RAM[adress];
+    byte lb = RAM[adress + 1];
+    // Return merged
+    return (int16_t)word(hb, lb);
+}
+// Save float to memory
+void saveFloat(float f, int adress) {
+    byte *b = (byte *)&f;
+    // Push bytes starting with highbytes
+    for (int i = 3; i >= 0; i--) {
+        RAM[adress + i] = b[i];
+    }
+}
+// Load float from memory
+float loadFloat(int adress) {
+    byte b[4];
+    // Pop bytes starting with lowbytes
+    for (int i = 0; i < 4; i++) {
+        b[i] = RAM[adress + i];
+    }
+
+    float *f = (float *)b;
+    return *f;
+}
+// Save long to memory, highbyte first
+void saveLong(int32_t l, int adress) {
+    for (int i = 0; i < 4; i++) {
+        RAM[adress + i] = l >> (24 - 8 * i);
+    }
+}
+// Load long from memory
+int32_t loadLong(int adress) {
+    uint32_t l = 0;
+    for (int i = 0; i < 4; i++) {
+        l = l << 8 | RAM[adress + i];
+    }
+    return l;
+}
+// Save string to memory
+void saveString(char *s, int adress) {
+    // Save chars
+    for (int i = 0; i < strlen(s); i++) {
+        RAM[adress + i] = s[i];
+    }
+    // Save terminating zero
+    RAM[adress + strlen(s)] = 0x00;
+}
+// Load string from memory
+char *loadString(int adress, int length) {
+    char *temp = new char[length];
+    // Pop chars including terminating zero
+    for (int i = length - 1; i >= 0; i--) {
+        temp[i] = RAM[adress + i];
+    }
+    return temp;
+}
+// Sort the memoryTable entries by position
+void sortMemory() {
+    bool sorted = false;
+    while (!sorted) {
+        sorted = true;
+        for (int i = 0; i < noOfVars - 1; i++) {
+            if (memoryTable[i].adress > memoryTable[i + 1].adress) {
+                // Swap them
+                variable temp = memoryTable[i];
+                memoryTable[i] = memoryTable[i + 1];
+                memoryTable[i + 1] = temp;
+                sorted = false;
+            }
+        }
+    }
+}
+// Function checks for available space in memory
+int getAvailableSpace(int size) {
+    // Check first block
+    if (memoryTable[0].adress >= size) {
+        return 0;
+    }
+
+    // Check between blocks
+    for (int i = 0; i < noOfVars - 1; i++) {
+        int availableSpace = memoryTable[i + 1].adress - (memoryTable[i].adress + memoryTable[i].length);
+        if (availableSpace >= size) {
+            return memoryTable[i].adress + memoryTable[i].length;
+        }
+    }
+
+    // Check last block
+    int lastEntry = memoryTable[noOfVars - 1].adress + memoryTable[noOfVars - 1].length;
+    if (MAXRAM - (int)lastEntry >= size) {
+        return lastEntry;
+    }
+
+    Serial.println(F("No space found"));
+    return -1;
+}
+
+int findFileInMemory(byte name, int procID) {
+    for (int i = 0; i < noOfVars; i++) {
+        if (memoryTable[i].name == name && memoryTable[i].procID == procID) {
+            return i;
+        }
+    }
+    return -1;  // Not found
+}
+
+// Function adds a variable of size bytes to the memory table, replacing the
+// one with the same name, and returns its address in RAM
+int allocateVariable(byte name, int procID, int type, int size) {
+    // Check if variable is already in memorytable and should be overwritten
+    int index = findFileInMemory(name, procID);
+
+    if (index != -1) {
+        // Shift variables to delete one
+        for (int i = index; i < noOfVars; i++) {
+            memoryTable[i] = memoryTable[i + 1];
+        }
+        noOfVars--;
+    }
+    // Index is after last var
+    index = noOfVars;
+    sortMemory();
+
+    int newAdress = (noOfVars > 0) ? getAvailableSpace(size) : 0;
+    variable newVariable = {.name = name,
+                            .type = type,
+                            .length = size,
+                            .adress = newAdress,
+                            .procID = procID};
+
+    memoryTable[index] = newVariable;
+    noOfVars++;
+    return newAdress;
+}
+
+void addMemoryEntry(byte name, int procID, int &stackP) {
+    // Check if there is space in the memory table
+    if (noOfVars >= MAX_VARIABLES) {
+        Serial.print(F("Error. Not enough space in the memory table"));
+        return;
+    }
+
+    int type = popByte(procID, stackP);
+    int size = (type != 3) ? typeSize(type) : popByte(procID, stackP);
+    int newAdress = allocateVariable(name, procID, type, size);
+
+    switch (type) {
+        case 1: {
+            // Char
+            saveChar(popVal(procID, stackP, type), newAdress);
+            break;
+        }
+        case 2: {
+            // Int
+            saveInt(popVal(procID, stackP, type), newAdress);
+            break;
+        }
+        case 3: {
+            // String
+            char s[STACKSIZE];
+            saveString(popString(procID, stackP, size, s), newAdress);
+            break;
+        }
+        case 4: {
+            // Float
+            saveFloat(popVal(procID, stackP, type), newAdress);
+            break;
+        }
+        case LONG:
+        case FIXED: {
+            saveLong(popLong(procID, stackP), newAdress);
+            break;
+        }
+        case STRINGREF: {
+            // Keep the handle, the string stays in the file
+            stringRef ref = popStringRef(procID, stackP);
+            saveInt(ref.offset, newAdress);
+            saveChar(ref.size, newAdress + 2);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void getMemoryEntry(byte name, int procID, int &stackP) {
+    int index = findFileInMemory(name, procID);
+    if (index == -1) {
+        Serial.println(F("Error. This variable doesn't exist."));
+        return;
+    }
+
+    int type = memoryTable[index].type;
+    int length = memoryTable[index].length;
+    switch (type) {
+        case 1: {
+            // Char
+            char temp = loadChar(memoryTable[index].adress);
+            pushChar(procID, stackP, temp);
+            break;
+        }
+        case 2: {
+            // Int
+            int temp = loadInt(memoryTable[index].adress);
+            pushInt(procID, stackP, temp);
+            break;
+        }
+        case 3: {
+            // String
+            pushString(procID, stackP, loadString(memoryTable[index].adress, length));
+            break;
+        }
+        case 4: {
+            // Float
+            pushFloat(procID, stackP, loadFloat(memoryTable[index].adress));
+            break;
+        }
+        case LONG:
+        case FIXED: {
+            pushLong(procID, stackP, loadLong(memoryTable[index].adress), type);
+            break;
+        }
+        case STRINGREF: {
+            stringRef ref = {loadInt(memoryTable[index].adress), (byte)loadChar(memoryTable[index].adress + 2)};
+            pushStringRef(procID, stackP, ref);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void deleteVars(int procID) {
+    // Delete all variables for a process
+    for (int j = 0; j < noOfVars; j++) {
+        if (memoryTable[j].procID == procID) {
+            for (int i = j; i < noOfVars; i++) {
+                memoryTable[i] = memoryTable[i + 1];
+            }
+            noOfVars--;
+        }
+    }
+}
+
+/*  
+ *  |-----------------------------------------------------------------------------------|
+ *  |                                       PROCESS                                     |
+ *  |-----------------------------------------------------------------------------------|
+ */
+
+int getPid(int id)
+// Find the index of a process in the process table
+{
+    int slot = pidSlot(id);
+    // A stopped process or an older generation in the same slot does not match
+    if (id < 0 || slot >= PROCESS_TABLE_SIZE || processTable[slot].state == '0' ||
+        processTable[slot].procID != id) {
+        return -1;
+    }
+    return slot;
+}
+
+// Function returns the list a process in the given state is kept in, or NULL
+signed char* processList(char state) {
+    if (state == 'r') {
+        return &readyHead;
+    }
+    if (state == 'w') {
+        return &sleepHead;
+    }
+    return NULL;
+}
+
+// Remove a process from the list it is in
+void unlinkProcess(int processIndex, signed char* head) {
+    process& proc = processTable[processIndex];
+    if (proc.prev == -1) {
+        *head = proc.next;
+    } else {
+        processTable[proc.prev].next = proc.next;
+    }
+    if (proc.next != -1) {
+        processTable[proc.next].prev = proc.prev;
+    }
+}
+
+// Add a process to a list, waiting processes are kept sorted by release time
+void linkProcess(int processIndex, signed char* head) {
+    process& proc = processTable[processIndex];
+    int prev = -1;
+    int next = *head;
+    if (head == &sleepHead) {
+        while (next != -1 && (int32_t)(processTable[next].release - proc.release) <= 0) {
+            prev = next;
+            next = processTable[next].next;
+        }
+    }
+    proc.prev = prev;
+    proc.next = next;
+    if (prev == -1) {
+        *head = processIndex;
+    } else {
+        processTable[prev].next = processIndex;
+    }
+    if (next != -1) {
+        processTable[next].prev = processIndex;
+    }
+}
+
+void changeProcessState(int processIndex, char state) {
+    // Change the state of a process in the process table
+    if (state != 'r' && state != 'w' && state != 'e' && state != 'p' && state != '0') {
+        Serial.println(F("Not a valid state"));
+        return;
+    }
+    if (processTable[processIndex].state == state) {
+        Serial.print(F("Process already is in "));
+        Serial.print(state);
+        Serial.println(F(" state"));
+        return;
+    }
+    // Move the process to the list of its new state
+    signed char* list = processList(processTable[processIndex].state);
+    if (list != NULL) {
+        unlinkProcess(processIndex, list);
+    }
+    processTable[processIndex].state = state;
+    list = processList(state);
+    if (list != NULL) {
+        linkProcess(processIndex, list);
+    }
+}
+
+// Function returns the number of operand bytes following the opcode at address
+int operandLength(int address) {
+    switch (fileRead(address)) {
+        case CHAR:
+        case SET:
+        case GET:
+        case IF:
+        case ELSE:
+            return 1;
+        case INT:
+        case WHILE:
+        case WIDEIF:
+        case WIDEELSE:
+            return 2;
+        case STRINGREF:
+            return 3;
+        case FLOAT:
+        case LONG:
+        case FIXED:
+        case WIDEWHILE:
+            return 4;
+        case STRING: {
+            // Characters including terminating zero
+            int length = 1;
+            while (fileRead(address + length) != 0) {
+                length++;
+            }
+            return length;
+        }
+        default:
+            return 0;
+    }
+}
+
+// Function reads a 16-bit operand, highbyte first
+int readWord(int address) {
+    return word(fileRead(address), fileRead(address + 1));
+}
+// Function returns the offset of the code in the file at address. A
+// compressed file starts with a dictionary: DICTIONARY n, the offsets of the
+// n macros and of the code, and the macros themselves.
+int codeStart(int address) {
+    if (fileRead(address) != DICTIONARY) {
+        return 0;
+    }
+    return fileRead(address + 2 + fileRead(address + 1));
+}
+// Function returns the next code byte of a process, from the macro that is
+// being expanded if there is one
+byte fetch(process& proc) {
+    if (proc.macroEnd != 0) {
+        byte b = fileRead(proc.address + proc.macroPos++);
+        if (proc.macroPos == proc.macroEnd) {
+            proc.macroEnd = 0;
+        }
+        return b;
+    }
+    return fileRead(proc.address + proc.pc++);
+}
+// Function returns the next opcode of a process. A macro of a compressed
+// file is expanded from the dictionary as it is fetched, macros hold whole
+// instructions without branches. Operand bytes are never macros.
+byte fetchOpcode(process& proc) {
+    if (proc.macroEnd == 0) {
+        byte b = fileRead(proc.address + proc.pc);
+        if (b >= MACRO && b < MACRO + MAX_MACROS && programTable[proc.program].codeStart != 0) {
+            int entry = proc.address + 2 + b - MACRO;
+            proc.pc++;
+            proc.macroPos = fileRead(entry);
+            proc.macroEnd = fileRead(entry + 1);
+        }
+    }
+    return fetch(proc);
+}
+// Function returns the condition code length operand of a WHILE or WIDEWHILE
+int conditionLength(int address) {
+    if (fileRead(address) == WIDEWHILE) {
+        return readWord(address + 1);
+    }
+    return fileRead(address + 1);
+}
+
+// Function returns the target of the forward branch at offset pc of the file
+// at address: past the block of an IF or ELSE, or past the ENDWHILE of a WHILE
+int forwardTarget(int address, int pc) {
+    address += pc;
+    switch (fileRead(address)) {
+        case IF:
+        case ELSE:
+            return pc + 2 + fileRead(address + 1);
+        case WIDEIF:
+        case WIDEELSE:
+            return pc + 3 + readWord(address + 1);
+        case WHILE:
+            return pc + 4 + fileRead(address + 2);
+        case WIDEWHILE:
+            return pc + 6 + readWord(address + 3);
+        default:
+            return pc;
+    }
+}
+
+// Function returns the first entry to look at for the branch at offset from in
+// a jump table of 1 << bits entries
+byte jumpSlot(int from, byte bits) {
+    return (uint16_t)(from * 40503u) >> (16 - bits);
+}
+
+// Function adds a resolved branch to the jump table of a program, or only
+// counts it while the table has not been allocated yet
+bool addJump(program& proc, int& noOfJumps, int from, int to, int length) {
+    if (to < 0 || to > length) {
+        return false;
+    }
+    noOfJumps++;
+    if (proc.jumpBits > 0) {
+        // Linear probing, the table always has free entries
+        jump* table = jumpPool + proc.firstJump;
+        byte mask = (1 << proc.jumpBits) - 1;
+        byte slot = jumpSlot(from, proc.jumpBits);
+        while (table[slot].from != -1) {
+            slot = (slot + 1) & mask;
+        }
+        table[slot].from = from;
+        table[slot].to = to;
+    }
+    return true;
+}
+
+// Function resolves all branch targets of a program into absolute offsets,
+// returns the number of branches or -1 if the control flow is invalid
+int resolveJumps(program& proc, int length) {
+    int whileStart[MAX_WHILE_DEPTH];
+    int depth = 0;
+    int loopStart = -1;
+    int noOfJumps = 0;
+
+    int pc = proc.codeStart;
+    while (pc < length) {
+        int address = proc.address + pc;
+        switch (fileRead(address)) {
+            case IF:
+            case ELSE:
+            case WIDEIF:
+            case WIDEELSE: {
+                // Jump over the code block following the length operand
+                if (!addJump(proc, noOfJumps, pc, forwardTarget(proc.address, pc), length)) {
+                    return -1;
+                }
+                break;
+            }
+            case WHILE:
+            case WIDEWHILE: {
+                // Jump past the matching ENDWHILE
+                if (depth >= MAX_WHILE_DEPTH ||
+                    !addJump(proc, noOfJumps, pc, forwardTarget(proc.address, pc), length)) {
+                    return -1;
+                }
+                whileStart[depth++] = pc;
+                break;
+            }
+            case ENDWHILE: {
+                // Jump back to the condition code in front of the matching WHILE,
+                // which has to exit right behind this ENDWHILE
+                if (depth == 0) {
+                    return -1;
+                }
+                int start = whileStart[--depth];
+                if (forwardTarget(proc.address, start) != pc + 1 ||
+                    !addJump(proc, noOfJumps, pc,
+                             start - conditionLength(proc.address + start), length)) {
+                    return -1;
+                }
+                break;
+            }
+            case LOOP: {
+                loopStart = pc + 1;
+                break;
+            }
+            case ENDLOOP: {
+                if (loopStart == -1 || !addJump(proc, noOfJumps, pc, loopStart, length)) {
+                    return -1;
+                }
+                break;
+            }
+            default:
+                break;
+        }
+        pc += 1 + operandLength(address);
+    }
+    return depth == 0 ? noOfJumps : -1;
+}
+
+// Function gives a program a jump table for its branches at the end of the
+// pool and fills it, returns false if the pool is full
+bool allocateJumps(program& proc, int length, int noOfJumps) {
+    proc.jumpBits = 0;
+    if (noOfJumps == 0) {
+        return true;
+    }
+    // At most three quarters full, so a lookup rarely takes more than two probes
+    byte bits = 1;
+    while ((1 << bits) * 3 < noOfJumps * 4) {
+        bits++;
+    }
+    if (noOfPoolJumps + (1 << bits) > JUMP_POOL_SIZE) {
+        return false;
+    }
+    proc.firstJump = noOfPoolJumps;
+    proc.jumpBits = bits;
+    noOfPoolJumps += 1 << bits;
+    for (int i = 0; i < 1 << bits; i++) {
+        jumpPool[proc.firstJump + i].from = -1;
+    }
+    resolveJumps(proc, length);
+    return true;
+}
+
+// Function returns the jump table of a program that stops being used to the
+// pool, the tables behind it move down
+void freeJumps(program& proc) {
+    if (proc.jumpBits == 0) {
+        return;
+    }
+    int size = 1 << proc.jumpBits;
+    for (int i = proc.firstJump; i + size < noOfPoolJumps; i++) {
+        jumpPool[i] = jumpPool[i + size];
+    }
+    noOfPoolJumps -= size;
+    for (int i = 0; i < PROCESS_TABLE_SIZE; i++) {
+        if (programTable[i].users > 0 && programTable[i].jumpBits > 0 &&
+            programTable[i].firstJump > proc.firstJump) {
+            programTable[i].firstJump -= size;
+        }
+    }
+    proc.jumpBits = 0;
+}
+
+// Function returns the resolved target of the branch at offset from, every
+// branch of a running program is in its jump table
+int jumpTarget(int index, int from) {
+    program& proc = programTable[processTable[index].program];
+    jump* table = jumpPool + proc.firstJump;
+    byte mask = (1 << proc.jumpBits) - 1;
+    byte slot = jumpSlot(from, proc.jumpBits);
+    while (table[slot].from != from) {
+        slot = (slot + 1) & mask;
+    }
+    return table[slot].to;
+}
+
+// Function returns the program of the file at address, or -1 if it is not running
+int findProgram(int address) {
+    for (int i = 0; i < PROCESS_TABLE_SIZE; i++) {
+        if (programTable[i].users > 0 && programTable[i].address == address) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Point the processes and programs using the file at from to its new position
+void relocateFile(int from, int to) {
+    for (int i = 0; i < PROCESS_TABLE_SIZE; i++) {
+        if (processTable[i].state == '0') {
+            continue;
+        }
+        if (processTable[i].address == from) {
+            processTable[i].address = to;
+        }
+        if (processTable[i].fileAddress == from) {
+            processTable[i].fileAddress = to;
+        }
+    }
+    int index = findProgram(from);
+    if (index != -1) {
+        programTable[index].address = to;
+    }
+}
+
+// Function returns whether the file at address is run or opened by a process
+bool fileInUse(int address) {
+    if (findProgram(address) != -1) {
+        return true;
+    }
+    for (int i = 0; i < PROCESS_TABLE_SIZE; i++) {
+        if (processTable[i].state != '0' && processTable[i].fileAddress == address) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Function returns the program of a file for a new process, or -1 if the
+// control flow of the file is invalid or its jump table does not fit
+int loadProgram(int fileIndex) {
+    FATEntry file = getFile(fileIndex);
+    int index = findProgram(file.beginPosition);
+    if (index == -1) {
+        // There is a program for every process, so a free one exists
+        index = 0;
+        while (programTable[index].users > 0) {
+            index++;
+        }
+        programTable[index].address = file.beginPosition;
+        programTable[index].codeStart = codeStart(programTable[index].address);
+        // Check the branches, then resolve their targets once into a jump
+        // table, so taken branches are a single assignment
+        programTable[index].jumpBits = 0;
+        int noOfJumps = resolveJumps(programTable[index], file.length);
+        if (noOfJumps == -1) {
+            Serial.println(F("Error. Invalid control flow in file."));
+            return -1;
+        }
+        if (!allocateJumps(programTable[index], file.length, noOfJumps)) {
+            Serial.println(F("Error. Not enough space for the jump table."));
+            return -1;
+        }
+    }
+    programTable[index].users++;
+    return index;
+}
+
+// Function starts a new process and returns its PID, or -1 on failure
+int runProcess(const char *filename, byte priority) {
+    // Run a new process
+
+    // Check if process table has space
+    int slot = 0;
+    while (slot < PROCESS_TABLE_SIZE && processTable[slot].state != '0') {
+        slot++;
+    }
+    if (slot == PROCESS_TABLE_SIZE) {
+        Serial.println(F("Error. Not enough space in the process table"));
+        return -1;
+    }
+    // Check if file exists
+    int fileIndex = getFileInFAT(filename);
+    
+    if (fileIndex == -1) {
+        Serial.println(F("File does not exist."));
+        return -1;
+    }
+
+    // Initialize a new process with default values
+    process newProcess;
+
+    // Copy the filename to the process name
+    strcpy(newProcess.name, filename);
+    newProcess.procID = generation[slot] << SLOT_BITS | slot;
+    newProcess.state = '0';
+    newProcess.pc = 0;
+    newProcess.fp = 0;
+    newProcess.sp = 0;
+    newProcess.address = getFile(fileIndex).beginPosition;
+    newProcess.fileAddress = -1;
+    newProcess.priority = priority;
+    // Join at the current pass, so the process gets no credit for the past
+    newProcess.pass = globalPass;
+    newProcess.instructions = 0;
+    newProcess.sleeping = false;
+#if EDF_ENABLED
+    newProcess.periodic = false;
+    newProcess.misses = 0;
+    newProcess.maxLateness = 0;
+#endif
+    newProcess.budget = defaultBudget;
+    newProcess.sinceWait = 0;
+#if PROFILING_ENABLED
+    newProcess.cpuMicros = 0;
+#endif
+
+    int programIndex = loadProgram(fileIndex);
+    if (programIndex == -1) {
+        return -1;
+    }
+    newProcess.program = programIndex;
+    newProcess.pc = programTable[programIndex].codeStart;
+    newProcess.macroEnd = 0;
+
+    processTable[slot] = newProcess;
+    changeProcessState(slot, 'r');
+    noOfProc++;
+
+    Serial.print(F("Proces: "));
+    Serial.print(newProcess.procID);
+    Serial.println(F(" has been started"));
+    return newProcess.procID;
+}
+
+// Suspend a process by changing its state to paused
+void suspendProcess(int id) {
+    Serial.print(F("Suspending process "));
+    Serial.println(id);
+    int processIndex = getPid(id);
+    if (processIndex == -1) {
+        Serial.println(F("processId doesn't exist"));
+        return;
+    }
+
+    if (processTable[processIndex].state == '0') {
+        Serial.println(F("Process already ended"));
+        return;
+    }
+
+    changeProcessState(processIndex, 'p');
+    Serial.print(F("Process with PID: "));
+    Serial.print(id);
+    Serial.println(F(" has been suspended."));
+}
+
+// Resume a suspended process by changing its state to running
+void resumeProcess(int id) {
+    int processIndex = getPid(id);
+    if (processIndex == -1) {
+        Serial.println(F("processId doesn't exist"));
+        return;
+    }
+
+    if (processTable[processIndex].state != 'p') {
+        Serial.println(F("Process is not suspended"));
+        return;
+    }
+
+    // A process suspended in DELAYUNTIL waits for its release again
+    changeProcessState(processIndex, processTable[processIndex].sleeping ? 'w' : 'r');
+    processTable[processIndex].sinceWait = 0;
+    // A suspended process gets no credit for the time it was not running
+    if ((int16_t)(processTable[processIndex].pass - globalPass) < 0) {
+        processTable[processIndex].pass = globalPass;
+    }
+    Serial.print(F("Process with PID: "));
+    Serial.print(id);
+    Serial.println(F(" has been resumed."));
+}
+
+// Change the priority of a process
+void setPriority(int id, int priority) {
+    int processIndex = getPid(id);
+    if (processIndex == -1) {
+        Serial.println(F("processId doesn't exist"));
+        return;
+    }
+    if (priority < MIN_PRIORITY || priority > MAX_PRIORITY) {
+        Serial.println(F("Error. Priority must be between 1 and 10."));
+        return;
+    }
+    processTable[processIndex].priority = priority;
+    Serial.print(F("Process with PID: "));
+    Serial.print(id);
+    Serial.print(F(" has priority "));
+    Serial.println(priority);
+}
+
+// Change the instruction budget of a process, 0 removes it
+void setBudget(int id, uint16_t budget) {
+    int processIndex = getPid(id);
+    if (processIndex == -1) {
+        Serial.println(F("processId doesn't exist"));
+        return;
+    }
+    processTable[processIndex].budget = budget;
+    processTable[processIndex].sinceWait = 0;
+    Serial.print(F("Process with PID: "));
+    Serial.print(id);
+    Serial.print(F(" has budget "));
+    Serial.println(budget);
+}
+
+/*  
+ *  |-----------------------------------------------------------------------------------|
+ *  |                                      EVENTS                                       |
+ *  |-----------------------------------------------------------------------------------|
+ */
+void postEvent(int n) {
+    if (events[n].pending < 255) {
+        events[n].pending++;
+    }
+}
+// Interrupt service routines, attachInterrupt() takes no argument for them
+void postEvent0() { postEvent(0); }
+void postEvent1() { postEvent(1); }
+void (*const eventHandlers[NO_OF_EVENTS])() PROGMEM = {postEvent0, postEvent1};
+
+// Function returns the event source of pin, or -1 if it has no external interrupt
+int eventSourceOf(int pin) {
+    int n = digitalPinToInterrupt(pin);
+    return (n >= 0 && n < NO_OF_EVENTS) ? n : -1;
+}
+// Attach the interrupt of pin to a process, mode is LOW, CHANGE, FALLING or RISING
+void attachEvent(int procID, int pin, int mode) {
+    int n = eventSourceOf(pin);
+    if (n == -1) {
+        Serial.println(F("Error. Pin has no external interrupt."));
+        return;
+    }
+    if (events[n].procID != -1 && events[n].procID != procID) {
+        Serial.println(F("Error. Interrupt is attached to another process."));
+        return;
+    }
+    if (mode != LOW && mode != CHANGE && mode != FALLING && mode != RISING) {
+        Serial.println(F("Error. Invalid interrupt mode."));
+        return;
+    }
+    detachInterrupt(n);
+    events[n].procID = procID;
+    events[n].pin = pin;
+    events[n].pending = 0;
+    attachInterrupt(n, (void (*)())pgm_read_ptr(&eventHandlers[n]), mode);
+}
+// Detach the interrupt of pin if the process has attached it
+void detachEvent(int procID, int pin) {
+    int n = eventSourceOf(pin);
+    if (n != -1 && events[n].procID == procID) {
+        detachInterrupt(n);
+        events[n].procID = -1;
+    }
+}
+// Detach all interrupts of a process
+void detachEvents(int procID) {
+    for (int n = 0; n < NO_OF_EVENTS; n++) {
+        if (events[n].procID == procID) {
+            detachInterrupt(n);
+            events[n].procID = -1;
+        }
+    }
+}
+// Function takes a posted event of a process and returns its pin, -1 if the
+// process has no interrupt attached and NO_EVENT if none has been posted yet
+const int NO_EVENT = -2;
+int takeEvent(int procID) {
+    int pin = -1;
+    for (int n = 0; n < NO_OF_EVENTS; n++) {
+        if (events[n].procID != procID) {
+            continue;
+        }
+        if (events[n].pending != 0) {
+            noInterrupts();
+            events[n].pending--;
+            interrupts();
+            return events[n].pin;
+        }
+        pin = NO_EVENT;
+    }
+    return pin;
+}
+// Wake the processes waiting for an event that has been posted
+void wakeEventWaiters() {
+    for (int n = 0; n < NO_OF_EVENTS; n++) {
+        int processIndex = (events[n].pending != 0) ? getPid(events[n].procID) : -1;
+        if (processIndex != -1 && processTable[processIndex].state == 'e') {
+            changeProcessState(processIndex, 'r');
+            // Ahead of every ready process, so it runs next
+            processTable[processIndex].pass = globalPass - 1;
+        }
+    }
+}
+
+// Stop a process by changing its state to terminated
+void stopProcess(int id) {
+    int processIndex = getPid(id);
+    if (processIndex == -1) {
+        Serial.println(F("processId doesn't exist"));
+        return;
+    }
+
+    if (processTable[processIndex].state == '0') {
+        Serial.println(F("Process already ended"));
+        return;
+    }
+    // Delete all variables of process from memory
+    deleteVars(id);
+    detachEvents(id);
+    changeProcessState(processIndex, '0'); // Change to terminated, frees the slot
+    generation[processIndex]++;
+    closeFile(processTable[processIndex]);
+    program& proc = programTable[processTable[processIndex].program];
+    if (--proc.users == 0) {
+        freeJumps(proc);
+    }
+
+    Serial.print(F("Process with PID: "));
+    Serial.print(id);
+    Serial.println(F(" has been killed."));
+    noOfProc--;
+}
+
+// Show the list of processes with their ID, state, and name
+void showProcesses() {
+    Serial.println(F("List of active processes:"));
+
+    for (int i = 0; i < PROCESS_TABLE_SIZE; i++) {
+        if (processTable[i].state != '0') {
+            Serial.print(F("PID: "));
+            Serial.print(processTable[i].procID);
+            Serial.print(F(" - Status: "));
+            Serial.print(processTable[i].state);
+            Serial.print(F(" - Priority: "));
+            Serial.print(processTable[i].priority);
+            Serial.print(F(" - Instructions: "));
+            Serial.print(processTable[i].instructions);
+#if EDF_ENABLED
+            if (processTable[i].periodic) {
+                Serial.print(F(" - Misses: "));
+                Serial.print(processTable[i].misses);
+                Serial.print(F(" (max "));
+                Serial.print(processTable[i].maxLateness);
+                Serial.print(F(" ms)"));
+            }
+#endif
+            if (processTable[i].budget != 0) {
+                Serial.print(F(" - Budget: "));
+                Serial.print(processTable[i].budget);
+            }
+            Serial.print(F(" - Name: "));
+            Serial.println(processTable[i].name);
+        }
+    }
+}
+
+#if DUMP_ENABLED
+/*  
+ *  |-----------------------------------------------------------------------------------|
+ *  |                                       DUMP                                        |
+ *  |-----------------------------------------------------------------------------------|
+ */
+// Mnemonics of opcodes CHAR to WAITEVENT, followed by those from IF onwards
+const char mnemonics[] PROGMEM =
+    "CHAR INT STRING FLOAT SET GET INCREMENT DECREMENT PLUS MINUS TIMES DIVIDEDBY "
+    "MODULUS UNARYMINUS EQUALS NOTEQUALS LESSTHAN LESSTHANOREQUALS GREATERTHAN "
+    "GREATERTHANOREQUALS LOGICALAND LOGICALOR LOGICALXOR LOGICALNOT BITWISEAND "
+    "BITWISEOR BITWISEXOR BITWISENOT TOCHAR TOINT TOFLOAT ROUND FLOOR CEIL MIN MAX "
+    "ABS CONSTRAIN MAP POW SQ SQRT DELAY DELAYUNTIL MILLIS PINMODE ANALOGREAD "
+    "ANALOGWRITE DIGITALREAD DIGITALWRITE PRINT PRINTLN OPEN CLOSE WRITE READINT "
+    "READCHAR READFLOAT READSTRING LONG TOLONG FIXED TOFIXED STRINGREF ATTACHEVENT "
+    "DETACHEVENT WAITEVENT "
+    "IF ELSE ENDIF WHILE ENDWHILE LOOP ENDLOOP STOP FORK WAITUNTILDONE WIDEIF "
+    "WIDEELSE WIDEWHILE";
+
+// Print the mnemonic of an opcode
+void printMnemonic(byte opcode) {
+    int index;
+    if (opcode >= CHAR && opcode <= WAITEVENT) {
+        index = opcode - CHAR;
+    } else if (opcode >= IF && opcode <= WIDEWHILE) {
+        index = WAITEVENT - CHAR + 1 + opcode - IF;
+    } else if (opcode >= MACRO && opcode < MACRO + MAX_MACROS) {
+        Serial.print(F("MACRO "));
+        Serial.print(opcode - MACRO);
+        return;
+    } else {
+        Serial.print(F("OPCODE "));
+        Serial.print(opcode);
+        return;
+    }
+    // Skip the preceding mnemonics
+    const char* letter = mnemonics;
+    while (index > 0) {
+        if (pgm_read_byte(letter++) == ' ') {
+            index--;
+        }
+    }
+    char c;
+    while ((c = pgm_read_byte(letter++)) != ' ' && c != '\0') {
+        Serial.print(c);
+    }
+}
+
+// Print the instructions from offset pc up to length of the file at address
+void dumpCode(int address, int pc, int length) {
+    while (pc < length) {
+        feedWatchdog();
+        byte opcode = fileRead(address + pc);
+        int operand = address + pc + 1;
+        Serial.print(pc);
+        Serial.print(F(":\t"));
+        printMnemonic(opcode);
+        switch (opcode) {
+            case CHAR: {
+                Serial.print(F(" '"));
+                Serial.print((char)fileRead(operand));
+                Serial.print('\'');
+                break;
+            }
+            case INT: {
+                Serial.print(' ');
+                Serial.print((int16_t)readWord(operand));
+                break;
+            }
+            case FLOAT: {
+                byte b[4];
+                for (int i = 3; i >= 0; i--) {
+                    b[i] = fileRead(operand++);
+                }
+                Serial.print(' ');
+                Serial.print(*(float*)b, 5);
+                break;
+            }
+            case LONG: {
+                Serial.print(' ');
+                Serial.print((int32_t)((uint32_t)readWord(operand) << 16 | (uint16_t)readWord(operand + 2)));
+                break;
+            }
+            case STRINGREF: {
+                int offset = readWord(operand);
+                Serial.print(' ');
+                Serial.print(offset);
+                Serial.print(F(" \""));
+                for (int i = 0; i < (int)fileRead(operand + 2) - 1; i++) {
+                    Serial.print((char)fileRead(address + offset + i));
+                }
+                Serial.print('"');
+                break;
+            }
+            case FIXED: {
+                Serial.print(' ');
+                printFixed((uint32_t)readWord(operand) << 16 | (uint16_t)readWord(operand + 2));
+                break;
+            }
+            case STRING: {
+                Serial.print(F(" \""));
+                for (char c; (c = fileRead(operand)) != 0 && operand < address + length; operand++) {
+                    Serial.print(c);
+                }
+                Serial.print('"');
+                break;
+            }
+            case SET:
+            case GET: {
+                Serial.print(' ');
+                Serial.print((char)fileRead(operand));
+                break;
+            }
+            case IF:
+            case ELSE:
+            case WHILE: {
+                Serial.print(' ');
+                Serial.print(fileRead(operand));
+                if (opcode == WHILE) {
+                    Serial.print(' ');
+                    Serial.print(fileRead(operand + 1));
+                }
+                break;
+            }
+            case WIDEIF:
+            case WIDEELSE:
+            case WIDEWHILE: {
+                Serial.print(' ');
+                Serial.print((unsigned int)readWord(operand));
+                if (opcode == WIDEWHILE) {
+                    Serial.print(' ');
+                    Serial.print((unsigned int)readWord(operand + 2));
+                }
+                break;
+            }
+            default:
+                break;
+        }
+        Serial.println();
+        pc += 1 + operandLength(address + pc);
+    }
+}
+// Print a file as bytecode instructions, a compressed file starts with its macros
+void dumpFile(const char* fileName) {
+    int fatIndex = getFileInFAT(fileName);
+    if (fatIndex == -1) {
+        Serial.println(F("File not found."));
+        return;
+    }
+    FATEntry file = getFile(fatIndex);
+    int address = file.beginPosition;
+    int start = codeStart(address);
+    if (start != 0) {
+        int macros = fileRead(address + 1);
+        for (int i = 0; i < macros; i++) {
+            Serial.print(F("MACRO "));
+            Serial.print(i);
+            Serial.println(':');
+            dumpCode(address, fileRead(address + 2 + i), fileRead(address + 3 + i));
+        }
+        Serial.println(F("CODE:"));
+    }
+    dumpCode(address, start, file.length);
+}
+#endif
+
+float increment(int type, float value) { return value + 1; }
+float decrement(int type, float value) { return value - 1; }
+// Integer versions, they wrap around like the AVR does
+int32_t incrementLong(int32_t value) { return (uint32_t)value + 1; }
+int32_t decrementLong(int32_t value) { return (uint32_t)value - 1; }
+int32_t incrementFixed(int32_t value) { return (uint32_t)value + FIXED_ONE; }
+int32_t decrementFixed(int32_t value) { return (uint32_t)value - FIXED_ONE; }
+
+typedef struct {
+    int operatorName;
+    float (*func)(int type, float value);
+    int32_t (*longFunc)(int32_t value);
+    int32_t (*fixedFunc)(int32_t value);
+    int returnType;
+} unaryFunction;
+
+const unaryFunction unary[] PROGMEM = {
+    {INCREMENT, &increment, &incrementLong, &incrementFixed, 0},
+    {DECREMENT, &decrement, &decrementLong, &decrementFixed, 0},
+};
+
+float plus(float x, float y) { return x + y; }
+float minus(float x, float y) { return x - y; }
+float times(float x, float y) { return x * y; }
+float dividedBy(float x, float y) { return x / y; }
+float equals(float x, float y) { return x == y; }
+float notEquals(float x, float y) { return x != y; }
+float lessThan(float x, float y) { return x < y; }
+float lessThanOrEquals(float x, float y) { return x <= y; }
+float greaterThan(float x, float y) { return x > y; }
+float greaterThanOrEquals(float x, float y) { return x >= y; }
+int32_t plusLong(int32_t x, int32_t y) { return (uint32_t)x + y; }
+int32_t minusLong(int32_t x, int32_t y) { return (uint32_t)x - y; }
+int32_t timesLong(int32_t x, int32_t y) { return (uint32_t)x * y; }
+// Division by zero gives zero instead of a trap on the host
+int32_t dividedByLong(int32_t x, int32_t y) {
+    if (y == 0) {
+        return 0;
+    }
+    return (y == -1) ? -(uint32_t)x : x / y;
+}
+int32_t equalsLong(int32_t x, int32_t y) { return x == y; }
+int32_t notEqualsLong(int32_t x, int32_t y) { return x != y; }
+int32_t lessThanLong(int32_t x, int32_t y) { return x < y; }
+int32_t lessThanOrEqualsLong(int32_t x, int32_t y) { return x <= y; }
+int32_t greaterThanLong(int32_t x, int32_t y) { return x > y; }
+int32_t greaterThanOrEqualsLong(int32_t x, int32_t y) { return x >= y; }
+// Q16.16 multiplication with 32-bit arithmetic: the integer parts and
+// fractions are multiplied separately, the product of the fractions is
+// truncated
+int32_t timesFixed(int32_t x, int32_t y) {
+    int32_t a = x >> 16;
+    uint32_t b = x & 0xFFFF;
+    int32_t c = y >> 16;
+    uint32_t d = y & 0xFFFF;
+    return ((uint32_t)(a * c) << 16) + a * (int32_t)d + (int32_t)b * c + ((b * d) >> 16);
+}
+// Q16.16 division: the integer quotient, followed by 16 fraction bits by
+// long division. Division by zero saturates.
+int32_t dividedByFixed(int32_t x, int32_t y) {
+    if (y == 0) {
+        return (x < 0) ? INT32_MIN : INT32_MAX;
+    }
+    bool negative = (x < 0) != (y < 0);
+    uint32_t n = (x < 0) ? -(uint32_t)x : x;
+    uint32_t d = (y < 0) ? -(uint32_t)y : y;
+    uint32_t quotient = n / d;
+    uint32_t remainder = n % d;
+    for (int i = 0; i < 16; i++) {
+        remainder <<= 1;
+        quotient <<= 1;
+        if (remainder >= d) {
+            remainder -= d;
+            quotient |= 1;
+        }
+    }
+    return negative ? -quotient : quotient;
+}
+
+typedef struct {
+    int operatorName;
+    float (*func)(float x, float y);
+    int32_t (*longFunc)(int32_t x, int32_t y);  // For operands without FLOAT
+    // For FIXED operands, NULL if the LONG version works on the representation
+    int32_t (*fixedFunc)(int32_t x, int32_t y);
+    int returnType;
+} binaryFunction;
+
+const binaryFunction binary[] PROGMEM = {
+    {PLUS, &plus, &plusLong, NULL, 0},
+    {MINUS, &minus, &minusLong, NULL, 0},
+    {TIMES, &times, &timesLong, &timesFixed, 0},
+    {DIVIDEDBY, &dividedBy, &dividedByLong, &dividedByFixed, 0},
+    {EQUALS, &equals, &equalsLong, NULL, CHAR},
+    {NOTEQUALS, &notEquals, &notEqualsLong, NULL, CHAR},
+    {LESSTHAN, &lessThan, &lessThanLong, NULL, CHAR},
+    {LESSTHANOREQUALS, &lessThanOrEquals, &lessThanOrEqualsLong, NULL, CHAR},
+    {GREATERTHAN, &greaterThan, &greaterThanLong, NULL, CHAR},
+    {GREATERTHANOREQUALS, &greaterThanOrEquals, &greaterThanOrEqualsLong, NULL, CHAR}
+};
+// MAP: value fromLow fromHigh toLow toHigh, like the Arduino map()
+float mapFloat(float x, float inMin, float inMax, float outMin, float outMax) {
+    return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+int32_t mapLong(int32_t x, int32_t inMin, int32_t inMax, int32_t outMin, int32_t outMax) {
+    return dividedByLong(timesLong(x - inMin, outMax - outMin), inMax - inMin) + outMin;
+}
+int32_t mapFixed(int32_t x, int32_t inMin, int32_t inMax, int32_t outMin, int32_t outMax) {
+    return dividedByFixed(timesFixed(x - inMin, outMax - outMin), inMax - inMin) + outMin;
+}
+
+// Function to copy the unary function of an operator from the unary array,
+// returns whether there is one
+bool findUnaryFunction(int operatorNum, unaryFunction& function) {
+    for (int i = 0; i < (int)(sizeof(unary) / sizeof(unaryFunction)); i++) {
+        memcpy_P(&function, &unary[i], sizeof(function));
+        if (function.operatorName == operatorNum) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Function to copy the binary function of an operator from the binary array,
+// returns whether there is one
+bool findBinaryFunction(int operatorNum, binaryFunction& function) {
+    for (int i = 0; i < (int)(sizeof(binary) / sizeof(binaryFunction)); i++) {
+        memcpy_P(&function, &binary[i], sizeof(function));
+        if (function.operatorName == operatorNum) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Function to execute a process at a given index in the processTable
+// Returns the executed opcode
+byte execute(int index) {
+    int procID = processTable[index].procID;
+    int& stackP = processTable[index].sp;
+    byte currentCommand = fetchOpcode(processTable[index]);
+    switch (currentCommand) {
+        case CHAR: {
+            // Handle CHAR bytecode
+            char temp = (char)fetch(processTable[index]);
+            pushChar(procID, stackP, temp);
+            break;
+        }
+        case INT: {
+            // Handle INT bytecode
+            int highByte = fetch(processTable[index]);
+            int lowByte = fetch(processTable[index]);
+            pushInt(procID, stackP, word(highByte, lowByte));
+            break;
+        }
+        case STRING: {
+            // Handle STRING bytecode
+            char string[12];
+            memset(&string[0], 0, sizeof(string));  // Empty string
+            int pointer = 0;
+            do {
+                int temp = (int)fetch(processTable[index]);
+                string[pointer] = (char)temp;
+                pointer++;
+            } while (string[pointer - 1] != 0);
+
+            pushString(procID, stackP, string);
+            break;
+        }
+        case FLOAT: {
+            // Handle FLOAT bytecode
+            byte b[4];
+            for (int i = 3; i >= 0; i--) {
+                byte temp = fetch(processTable[index]);
+                b[i] = temp;
+            }
+            float* f = (float*)b;
+            pushFloat(procID, stackP, *f);
+            break;
+        }
+        case LONG: {
+            // Handle LONG bytecode, highbyte first
+            uint32_t l = 0;
+            for (int i = 0; i < 4; i++) {
+                l = l << 8 | fetch(processTable[index]);
+            }
+            pushLong(procID, stackP, l);
+            break;
+        }
+        case FIXED: {
+            // Handle FIXED bytecode, Q16.16 highbyte first
+            uint32_t f = 0;
+            for (int i = 0; i < 4; i++) {
+                f = f << 8 | fetch(processTable[index]);
+            }
+            pushLong(procID, stackP, f, FIXED);
+            break;
+        }
+        case STRINGREF: {
+            // Handle STRINGREF bytecode, the string itself is not read
+            stringRef ref;
+            int highByte = fetch(processTable[index]);
+            int lowByte = fetch(processTable[index]);
+            ref.offset = word(highByte, lowByte);
+            ref.size = fetch(processTable[index]);
+            pushStringRef(procID, stackP, ref);
+            break;
+        }
+        case STOP: {
+            // Handle STOP bytecode
+            Serial.print(F("Process with pid: "));
+            Serial.print(procID);
+            Serial.println(F(" is finished."));
+#if PROFILING_ENABLED
+            Serial.print(F("Instructions: "));
+            Serial.print(processTable[index].instructions);
+            Serial.print(F(", CPU time: "));
+            Serial.print(processTable[index].cpuMicros);
+            Serial.println(F(" us"));
+#endif
+            deleteVars(procID);
+            stopProcess(procID);
+            Serial.println();
+            break;
+        }
+        case 51 ... 52: {  // PRINT and PRINTLN
+            // Handle PRINT and PRINTLN commands
+            int type = popByte(procID, stackP);
+            switch (type) {
+                case CHAR: {
+                    Serial.print(popChar(procID, stackP));
+                    break;
+                }
+                case INT: {
+                    Serial.print(popInt(procID, stackP));
+                    break;
+                }
+                case STRING: {
+                    int size = popByte(procID, stackP);
+                    char s[STACKSIZE];
+                    Serial.print(popString(procID, stackP, size, s));
+                    break;
+                }
+                case FLOAT: {
+                    Serial.print(popFloat(procID, stackP), 5);
+                    break;
+                }
+                case LONG: {
+                    Serial.print(popLong(procID, stackP));
+                    break;
+                }
+                case FIXED: {
+                    printFixed(popLong(procID, stackP));
+                    break;
+                }
+                case STRINGREF: {
+                    // Stream the string from the file
+                    stringRef ref = popStringRef(procID, stackP);
+                    for (int i = 0; i < ref.size - 1; i++) {
+                        Serial.print((char)fileRead(processTable[index].address + ref.offset + i));
+                    }
+                    break;
+                }
+                default:
+                    break;
+            }
+            if (currentCommand == 52) {
+                Serial.println();
+            }
+            break;
+        }
+        case SET: {
+            // Handle SET bytecode
+            char name = fetch(processTable[index]);
+
+            addMemoryEntry(name, procID, stackP);
+            break;
+        }
+        case GET: {
+            // Handle GET bytecode
+            char name = fetch(processTable[index]);
+            getMemoryEntry(name, procID, stackP);
+            break;
+        }
+        case DELAY: {
+            break;
+        }
+        case DELAYUNTIL: {
+            number target = popNumber(procID, stackP);
+            uint32_t now = programMillis();
+            // Times are compared by their difference, which survives wrap
+            // around. A target of another type than LONG holds the low 16 bits
+            // of the time, it is taken as the nearest time with those bits.
+            uint32_t temp = (target.type == LONG)
+                                     ? toLong(target)
+                                     : now + (int16_t)(toLong(target) - now);
+            process& proc = processTable[index];
+            if (proc.sleeping) {
+                // Woken by the scheduler, the target has been reached
+                proc.sleeping = false;
+            } else {
+                // Arrived at the target of the next job
+#if EDF_ENABLED
+                if (proc.periodic) {
+                    proc.period = temp - proc.release;
+                }
+                proc.periodic = true;
+#endif
+                proc.release = temp;
+                int32_t late = now - temp;
+                if (late < 0) {
+                    // Sleep until the target, the process is not ready meanwhile
+                    proc.sleeping = true;
+                    proc.pc--;
+                    pushIntegral(procID, stackP, target.type == LONG ? LONG : INT, temp);
+                    changeProcessState(index, 'w');
+                    proc.sinceWait = 0;
+                }
+#if EDF_ENABLED
+                if (late > 0) {
+                    // The job has overrun its deadline
+                    proc.misses++;
+                    if (late > proc.maxLateness) {
+                        proc.maxLateness = late;
+                    }
+                }
+#endif
+            }
+            break;
+        }
+        case MILLIS: {
+            pushLong(procID, stackP, programMillis());
+            break;
+        }
+        case PINMODE: {
+            popByte(procID, stackP);
+            int direction = popInt(procID, stackP);
+            popByte(procID, stackP);
+            int pin = popInt(procID, stackP);
+            pinMode(pin, direction);
+            break;
+        }
+        case DIGITALWRITE: {
+            popByte(procID, stackP);
+            int status = popInt(procID, stackP);
+            popByte(procID, stackP);
+            int pin = popInt(procID, stackP);
+            digitalWrite(pin, status);
+            break;
+        }
+        case OPEN: {
+            popByte(procID, stackP);
+            int fileSize = popInt(procID, stackP);
+            int type = popByte(procID, stackP);
+            char fileName[STACKSIZE];
+            popText(procID, stackP, type, processTable[index].address, fileName, sizeof(fileName));
+            // A process has a single file handle
+            closeFile(processTable[index]);
+            openFile(processTable[index], fileName, fileSize);
+            break;
+        }
+        case CLOSE: {
+            closeFile(processTable[index]);
+            break;
+        }
+        case WRITE: {
+            // Write the data of the value on top of the stack, highbyte first
+            int type = popByte(procID, stackP);
+            byte data[STACKSIZE];
+            int count;
+            if (type == STRING) {
+                count = popByte(procID, stackP);
+                popString(procID, stackP, count, (char*)data);
+            } else if (type == STRINGREF) {
+                // Copy the string from the program file in pieces
+                stringRef ref = popStringRef(procID, stackP);
+                int from = processTable[index].address + ref.offset;
+                for (int done = 0; done < ref.size; done += count) {
+                    count = min(ref.size - done, STACKSIZE);
+                    for (int i = 0; i < count; i++) {
+                        data[i] = fileRead(from + done + i);
+                    }
+                    writeFile(processTable[index], data, count);
+                }
+                break;
+            } else {
+                count = typeSize(type);
+                for (int i = count - 1; i >= 0; i--) {
+                    data[i] = popByte(procID, stackP);
+                }
+            }
+            writeFile(processTable[index], data, count);
+            break;
+        }
+        case READINT: {
+            byte data[2] = {0, 0};
+            readFile(processTable[index], data, 2);
+            pushInt(procID, stackP, word(data[0], data[1]));
+            break;
+        }
+        case READCHAR: {
+            byte data = 0;
+            readFile(processTable[index], &data, 1);
+            pushChar(procID, stackP, data);
+            break;
+        }
+        case READFLOAT: {
+            byte data[4] = {0, 0, 0, 0};
+            readFile(processTable[index], data, 4);
+            for (int i = 0; i < 4; i++) {
+                pushByte(procID, stackP, data[i]);
+            }
+            pushByte(procID, stackP, FLOAT);
+            break;
+        }
+        case READSTRING: {
+            // Read up to and including the terminating zero
+            char string[STACKSIZE - 2];
+            int length = 0;
+            byte letter = 1;
+            while (letter != 0 && length < (int)sizeof(string) - 1 &&
+                   readFile(processTable[index], &letter, 1)) {
+                string[length++] = letter;
+            }
+            string[length] = '\0';
+            pushString(procID, stackP, string);
+            break;
+        }
+        case FORK: {
+            int type = popByte(procID, stackP);
+            char fileName[STACKSIZE];
+            popText(procID, stackP, type, processTable[index].address, fileName, sizeof(fileName));
+            // Push the PID of the child, or -1 if it could not be started
+            pushInt(procID, stackP, runProcess(fileName, processTable[index].priority));
+            break;
+        }
+        case ANALOGREAD: {
+            int pin = toLong(popNumber(procID, stackP));
+            pushInt(procID, stackP, analogRead(pin));
+            break;
+        }
+        case DIGITALREAD: {
+            int pin = toLong(popNumber(procID, stackP));
+            pushInt(procID, stackP, digitalRead(pin));
+            break;
+        }
+        case ATTACHEVENT: {
+            int mode = toLong(popNumber(procID, stackP));
+            int pin = toLong(popNumber(procID, stackP));
+            attachEvent(procID, pin, mode);
+            break;
+        }
+        case DETACHEVENT: {
+            detachEvent(procID, toLong(popNumber(procID, stackP)));
+            break;
+        }
+        case WAITEVENT: {
+            int pin = takeEvent(procID);
+            if (pin == NO_EVENT) {
+                // Wait until an interrupt posts an event, then take it
+                processTable[index].pc--;
+                processTable[index].sinceWait = 0;
+                changeProcessState(index, 'e');
+            } else {
+                pushInt(procID, stackP, pin);
+            }
+            break;
+        }
+        case WAITUNTILDONE: {
+            popByte(procID,stackP);
+            int runningID = popInt(procID, stackP);
+            // The process has finished once its PID is no longer in use
+            if (getPid(runningID) != -1) {
+                processTable[index].pc--;
+                pushInt(procID, stackP, runningID);
+                processTable[index].sinceWait = 0;
+            }
+            break;
+        }
+        case IF:
+        case WIDEIF: {
+            // Skip the true code if the condition is zero, condition stays on stack
+            if (peekCondition(procID, stackP)) {
+                processTable[index].pc += (currentCommand == IF) ? 1 : 2;
+            } else {
+                processTable[index].pc = jumpTarget(index, processTable[index].pc - 1);
+            }
+            break;
+        }
+        case ELSE:
+        case WIDEELSE: {
+            // Skip the false code if the condition is non-zero, condition stays on stack
+            if (peekCondition(procID, stackP)) {
+                processTable[index].pc = jumpTarget(index, processTable[index].pc - 1);
+            } else {
+                processTable[index].pc += (currentCommand == ELSE) ? 1 : 2;
+            }
+            break;
+        }
+        case ENDIF: {
+            // Remove the condition from the stack
+            popCondition(procID, stackP);
+            break;
+        }
+        case WHILE:
+        case WIDEWHILE: {
+            // Leave the loop if the condition is zero
+            if (popCondition(procID, stackP)) {
+                processTable[index].pc += (currentCommand == WHILE) ? 2 : 4;
+            } else {
+                processTable[index].pc = jumpTarget(index, processTable[index].pc - 1);
+            }
+            break;
+        }
+        case ENDWHILE:
+        case ENDLOOP: {
+            // Jump back to the condition code or the start of the loop
+            processTable[index].pc = jumpTarget(index, processTable[index].pc - 1);
+            break;
+        }
+        case LOOP: {
+            break;
+        }
+        case TOCHAR:
+        case TOINT:
+        case TOFLOAT:
+        case TOLONG:
+        case TOFIXED: {
+            // Convert a numeric value to another type
+            number x = popNumber(procID, stackP);
+            if (currentCommand == TOFLOAT) {
+                pushFloat(procID, stackP, toFloat(x));
+            } else if (currentCommand == TOFIXED) {
+                pushIntegral(procID, stackP, FIXED, toFixed(x));
+            } else {
+                int type = (currentCommand == TOCHAR) ? CHAR : (currentCommand == TOINT) ? INT : LONG;
+                pushIntegral(procID, stackP, type, toLong(x));
+            }
+            break;
+        }
+        case 7 ... 8: {
+            // Handle unary functions
+            number x = popNumber(procID, stackP);
+            unaryFunction function;
+            findUnaryFunction(currentCommand, function);
+
+            switch (x.type) {
+                case CHAR:
+                case INT:
+                case LONG: {
+                    pushIntegral(procID, stackP, x.type, function.longFunc(x.l));
+                    break;
+                }
+                case FIXED: {
+                    pushIntegral(procID, stackP, FIXED, function.fixedFunc(x.l));
+                    break;
+                }
+                case FLOAT: {
+                    pushFloat(procID, stackP, function.func(x.type, x.f));
+                    break;
+                }
+                default:
+                    Serial.println(F("Execute: Default case"));
+                    break;
+            }
+            break;
+        }
+        case 9 ... 12:
+        case 15 ... 20: {
+            // Handle binary functions
+            number y = popNumber(procID, stackP);
+            number x = popNumber(procID, stackP);
+
+            binaryFunction function;
+            findBinaryFunction(currentCommand, function);
+            int type = resultType(x.type, y.type);
+            int returnType = function.returnType ? function.returnType : type;
+            switch (type) {
+                case CHAR:
+                case INT:
+                case LONG:
+                case FIXED: {
+                    // Integer kernels, FIXED operands as their Q16.16 representation
+                    int32_t (*kernel)(int32_t, int32_t) = function.longFunc;
+                    if (type == FIXED && function.fixedFunc != NULL) {
+                        kernel = function.fixedFunc;
+                    }
+                    pushIntegral(procID, stackP, returnType, kernel(toKernel(x, type), toKernel(y, type)));
+                    break;
+                }
+                case FLOAT: {
+                    float newValue = function.func(toFloat(x), toFloat(y));
+                    if (returnType == FLOAT) {
+                        pushFloat(procID, stackP, newValue);
+                    } else {
+                        pushIntegral(procID, stackP, returnType, newValue);
+                    }
+                    break;
+                }
+                default:
+                    Serial.println(F("Execute: Default case"));
+                    break;
+            }
+            break;
+        }
+        case CONSTRAIN:
+        case MAP: {
+            // Pop the operands, the last one first, and take the widest type
+            int count = (currentCommand == MAP) ? 5 : 3;
+            number operands[5];
+            int type = CHAR;
+            for (int i = count - 1; i >= 0; i--) {
+                operands[i] = popNumber(procID, stackP);
+                type = resultType(type, operands[i].type);
+            }
+            if (type == FLOAT) {
+                float v[5];
+                for (int i = 0; i < count; i++) {
+                    v[i] = toFloat(operands[i]);
+                }
+                pushFloat(procID, stackP, (count == 5) ? mapFloat(v[0], v[1], v[2], v[3], v[4]) : constrain(v[0], v[1], v[2]));
+            } else if (type == STRING || type == STRINGREF) {
+                Serial.println(F("Execute: Default case"));
+            } else {
+                int32_t v[5];
+                for (int i = 0; i < count; i++) {
+                    v[i] = toKernel(operands[i], type);
+                }
+                int32_t newValue;
+                if (count == 3) {
+                    newValue = constrain(v[0], v[1], v[2]);
+                } else if (type == FIXED) {
+                    newValue = mapFixed(v[0], v[1], v[2], v[3], v[4]);
+                } else {
+                    newValue = mapLong(v[0], v[1], v[2], v[3], v[4]);
+                }
+                pushIntegral(procID, stackP, type, newValue);
+            }
+            break;
+        }
+        default: {
+            Serial.println(F("Error. Unkown commandList."));
+            break;
+        }
+    }
+    return currentCommand;
+}
+
+#if PROFILING_ENABLED
+/*  
+ *  |-----------------------------------------------------------------------------------|
+ *  |                                     PROFILING                                     |
+ *  |-----------------------------------------------------------------------------------|
+ */
+// Function returns the counter slot of an opcode
+int profileSlot(byte opcode) {
+    if (opcode >= CHAR && opcode <= WAITEVENT) {
+        return opcode;
+    }
+    if (opcode >= IF && opcode <= WIDEWHILE) {
+        return WAITEVENT + 1 + opcode - IF;
+    }
+    return 0;
+}
+// Function returns the opcode counted in a slot
+byte slotOpcode(int slot) {
+    return (slot <= WAITEVENT) ? slot : IF + slot - WAITEVENT - 1;
+}
+
+// Execute one instruction and add it to the opcode and process counters
+void profileExecute(int index) {
+    int procID = processTable[index].procID;
+    unsigned long start = micros();
+    byte opcode = execute(index);
+    unsigned long time = micros() - start;
+
+    int slot = profileSlot(opcode);
+    opcodeCount[slot]++;
+    opcodeMicros[slot] += time;
+    // The process is gone if it has just stopped
+    int processIndex = getPid(procID);
+    if (processIndex != -1) {
+        processTable[processIndex].cpuMicros += time;
+    }
+}
+
+// Print the opcode and process counters
+void printStats() {
+    Serial.println(F("Opcode\t\tCount\tTime (us)"));
+    for (int slot = 0; slot < PROFILE_SLOTS; slot++) {
+        if (opcodeCount[slot] == 0) {
+            continue;
+        }
+#if DUMP_ENABLED
+        printMnemonic(slotOpcode(slot));
+#else
+        Serial.print(slotOpcode(slot));
+#endif
+        Serial.print(F("\t\t"));
+        Serial.print(opcodeCount[slot]);
+        Serial.print('\t');
+        Serial.println(opcodeMicros[slot]);
+    }
+    Serial.println();
+    Serial.println(F("PID\tName\t\tInstructions\tCPU time (us)"));
+    for (int i = 0; i < PROCESS_TABLE_SIZE; i++) {
+        if (processTable[i].state == '0') {
+            continue;
+        }
+        Serial.print(processTable[i].procID);
+        Serial.print('\t');
+        Serial.print(processTable[i].name);
+        Serial.print(F("\t\t"));
+        Serial.print(processTable[i].instructions);
+        Serial.print(F("\t\t"));
+        Serial.println(processTable[i].cpuMicros);
+    }
+}
+#endif
+
+// Function returns whether process a should run before process b, the
+// comparisons survive wrap around
+bool runsBefore(const process& a, const process& b) {
+#if EDF_ENABLED
+    if (schedulingMode == EDF_MODE && a.periodic != b.periodic) {
+        return a.periodic;
+    }
+    if (schedulingMode == EDF_MODE && a.periodic) {
+        uint32_t deadlineA = a.release + a.period;
+        uint32_t deadlineB = b.release + b.period;
+        if (deadlineA != deadlineB) {
+            return (int32_t)(deadlineA - deadlineB) < 0;
+        }
+    }
+#endif
+    return (int16_t)(a.pass - b.pass) < 0;
+}
+
+// Suspend a process that has run through its budget and report where it was
+void suspendRunaway(int processIndex) {
+    process& proc = processTable[processIndex];
+    changeProcessState(processIndex, 'p');
+    Serial.print(F("Error. Process "));
+    Serial.print(proc.procID);
+    Serial.print(F(" ("));
+    Serial.print(proc.name);
+    Serial.print(F(") ran over "));
+    Serial.print(proc.budget);
+    Serial.print(F(" instructions without waiting, suspended at pc "));
+    Serial.println(proc.pc);
+}
+
+void runProcesses() {
+    wakeEventWaiters();
+    // Wake the waiting processes whose release time has passed
+    uint32_t now = programMillis();
+    while (sleepHead != -1 && (int32_t)(now - processTable[sleepHead].release) >= 0) {
+        changeProcessState(sleepHead, 'r');
+    }
+    // Pick the ready process that runs first
+    int next = readyHead;
+    for (int i = next; i != -1; i = processTable[i].next) {
+        if (runsBefore(processTable[i], processTable[next])) {
+            next = i;
+        }
+    }
+    if (next == -1) {
+        return;
+    }
+    globalPass = processTable[next].pass;
+    processTable[next].pass += STRIDE / processTable[next].priority;
+    processTable[next].instructions++;
+#if PROFILING_ENABLED
+    profileExecute(next);
+#else
+    execute(next);
+#endif
+    process& proc = processTable[next];
+    if (proc.state == 'r' && proc.budget != 0 && ++proc.sinceWait > proc.budget) {
+        suspendRunaway(next);
+    }
+}
+
+/*  
+ *  |-----------------------------------------------------------------------------------|
+ *  |                                       BOOT                                        |
+ *  |-----------------------------------------------------------------------------------|
+ */
+// The autostart list and the checkpoint are files, so they are kept by every
+// storage backend. A new version is written under a temporary name first and
+// only takes the place of the old one once it is complete.
+const char AUTOSTART_FILE[] = ".autostart";
+const char CHECKPOINT_FILE[] = ".checkpoint";
+// A program that setup() starts
+struct autostartEntry {
+    char name[MAX_FILE_NAME_LENGTH];
+    byte priority;
+};
+const int MAX_AUTOSTART = 4;
+const byte CHECKPOINT_MAGIC = 0x44;
+
+// The temporary name of a file while its new version is written
+void temporaryName(char* temp, const char* fileName) {
+    strcpy(temp, fileName);
+    temp[0] = '#';
+}
+// Remove a file if it exists
+void dropFile(const char* fileName) {
+    int fatIndex = getFileInFAT(fileName);
+    if (fatIndex != -1) {
+        removeFile(fatIndex);
+    }
+}
+// Create the new version of a file under its temporary name, with data or
+// empty if data is NULL. Function returns its position, or -1 on failure.
+int createVersion(const char* fileName, int fileSize, const char* data) {
+    char temp[MAX_FILE_NAME_LENGTH];
+    temporaryName(temp, fileName);
+    // Left by a replacement that a reset interrupted
+    dropFile(temp);
+    return createFile(temp, fileSize, data);
+}
+// Drop the old version of a file and give the new one its name, both through
+// the FAT updates, so a reset in between leaves only the new version
+void commitVersion(const char* fileName) {
+    char temp[MAX_FILE_NAME_LENGTH];
+    temporaryName(temp, fileName);
+    dropFile(fileName);
+    int fatIndex = getFileInFAT(temp);
+    if (fatIndex != -1 && !renameFile(fatIndex, fileName)) {
+        Serial.println(F("Error: No space left for file."));
+    }
+}
+// Finish or undo a replacement that a reset interrupted. A new version next to
+// the old one may be incomplete, without the old one it is complete.
+void recoverVersion(const char* fileName) {
+    char temp[MAX_FILE_NAME_LENGTH];
+    temporaryName(temp, fileName);
+    if (getFileInFAT(temp) == -1) {
+        return;
+    }
+    if (getFileInFAT(fileName) != -1) {
+        dropFile(temp);
+    } else {
+        commitVersion(fileName);
+    }
+}
+// Replace a file by a new one of fileSize bytes with data. No file remains if
+// fileSize is 0.
+void replaceFile(const char* fileName, int fileSize, const char* data) {
+    if (fileSize == 0) {
+        dropFile(fileName);
+    } else if (createVersion(fileName, fileSize, data) != -1) {
+        commitVersion(fileName);
+    }
+}
+// Function reads the autostart list into list and returns its length
+int readAutostart(autostartEntry* list) {
+    int fatIndex = getFileInFAT(AUTOSTART_FILE);
+    if (fatIndex == -1) {
+        return 0;
+    }
+    FATEntry file = getFile(fatIndex);
+    int count = min(file.length / (int)sizeof(autostartEntry), MAX_AUTOSTART);
+    for (int i = 0; i < count; i++) {
+        storageGet(file.beginPosition + i * sizeof(autostartEntry), list[i]);
+    }
+    return count;
+}
+void printAutostart() {
+    autostartEntry list[MAX_AUTOSTART];
+    int count = readAutostart(list);
+    Serial.print(count);
+    Serial.println(F(" programs start at boot"));
+    for (int i = 0; i < count; i++) {
+        Serial.print(list[i].name);
+        Serial.print(F("\tpriority "));
+        Serial.println(list[i].priority);
+    }
+}
+// Add a program to the autostart list, or remove it if priority is 0
+void setAutostart(const char* fileName, byte priority) {
+    autostartEntry list[MAX_AUTOSTART];
+    int count = readAutostart(list);
+    int i = 0;
+    while (i < count && strcmp(list[i].name, fileName) != 0) {
+        i++;
+    }
+    if (priority == 0) {
+        if (i == count) {
+            Serial.println(F("Error. Program is not in the autostart list."));
+            return;
+        }
+        list[i] = list[--count];
+    } else {
+        if (getFileInFAT(fileName) == -1) {
+            Serial.println(F("File does not exist."));
+            return;
+        }
+        if (i == MAX_AUTOSTART) {
+            Serial.println(F("Error. Autostart list is full."));
+            return;
+        }
+        strcpy(list[i].name, fileName);
+        list[i].priority = priority;
+        count = max(count, i + 1);
+    }
+    replaceFile(AUTOSTART_FILE, count * sizeof(autostartEntry), (const char*)list);
+    printAutostart();
+}
+
+// Sequential access to the checkpoint file, with a running checksum. A
+// writer without an address only counts the bytes.
+struct checkpointStream {
+    int address;
+    int size;
+    byte check;
+};
+void checkpointPut(checkpointStream& stream, const void* data, int size) {
+    const byte* b = (const byte*)data;
+    for (int i = 0; i < size; i++) {
+        if (stream.address != -1) {
+            storage.update(stream.address + stream.size, b[i]);
+        }
+        stream.check += b[i];
+        stream.size++;
+    }
+}
+void checkpointGet(checkpointStream& stream, void* data, int size) {
+    byte* b = (byte*)data;
+    for (int i = 0; i < size; i++) {
+        b[i] = storage.read(stream.address + stream.size++);
+        stream.check += b[i];
+    }
+}
+// Function returns the Fletcher-16 checksum of a file
+uint16_t fileCheck(const FATEntry& file) {
+    byte sum1 = 0;
+    byte sum2 = 0;
+    for (int i = 0; i < file.length; i++) {
+        sum1 = (sum1 + fileRead(file.beginPosition + i)) % 255;
+        sum2 = (sum2 + sum1) % 255;
+    }
+    return word(sum2, sum1);
+}
+// Write the state of the running processes: per process the name, length and
+// checksum of its file, priority, state, timing, pc, macro position, stack and
+// variables. Open files are not part of it.
+void writeCheckpoint(checkpointStream& stream) {
+    byte count = noOfProc;
+    uint32_t now = programMillis();
+    checkpointPut(stream, &CHECKPOINT_MAGIC, 1);
+    checkpointPut(stream, &count, 1);
+    checkpointPut(stream, &now, sizeof(now));
+    for (int i = 0; i < PROCESS_TABLE_SIZE; i++) {
+        process& proc = processTable[i];
+        if (proc.state == '0') {
+            continue;
+        }
+        FATEntry file = getFile(getFileInFAT(proc.name));
+        int16_t length = file.length;
+        uint16_t check = fileCheck(file);
+        // Without EDF the checkpoint has the same layout, with no deadline
+#if EDF_ENABLED
+        byte flags = proc.sleeping | proc.periodic << 1;
+        int32_t period = proc.period;
+#else
+        byte flags = proc.sleeping;
+        int32_t period = 0;
+#endif
+        byte sp = proc.sp;
+        int16_t pc = proc.pc;
+        checkpointPut(stream, proc.name, sizeof(proc.name));
+        checkpointPut(stream, &length, sizeof(length));
+        checkpointPut(stream, &check, sizeof(check));
+        checkpointPut(stream, &proc.priority, 1);
+        checkpointPut(stream, &proc.state, 1);
+        checkpointPut(stream, &flags, 1);
+        checkpointPut(stream, &proc.release, sizeof(proc.release));
+        checkpointPut(stream, &period, sizeof(period));
+        checkpointPut(stream, &pc, sizeof(pc));
+        checkpointPut(stream, &proc.macroPos, 1);
+        checkpointPut(stream, &proc.macroEnd, 1);
+        checkpointPut(stream, &sp, 1);
+        checkpointPut(stream, stack[i], sp);
+        byte vars = 0;
+        for (int j = 0; j < noOfVars; j++) {
+            vars += memoryTable[j].procID == proc.procID;
+        }
+        checkpointPut(stream, &vars, 1);
+        for (int j = 0; j < noOfVars; j++) {
+            variable& var = memoryTable[j];
+            if (var.procID == proc.procID) {
+                byte header[3] = {var.name, (byte)var.type, (byte)var.length};
+                checkpointPut(stream, header, sizeof(header));
+                checkpointPut(stream, RAM + var.adress, var.length);
+            }
+        }
+    }
+}
+// Save the running processes, a warm restart resumes them instead of
+// starting the autostart list
+void saveCheckpoint() {
+    if (noOfProc == 0) {
+        // An empty checkpoint would keep the autostart list from starting
+        replaceFile(CHECKPOINT_FILE, 0, NULL);
+        Serial.println(F("Error. No processes running, checkpoint removed."));
+        return;
+    }
+    // The checksums of the programs are read from the storage
+    flushBlock();
+    checkpointStream counter = {-1, 0, 0};
+    writeCheckpoint(counter);
+    int position = createVersion(CHECKPOINT_FILE, counter.size + 1, NULL);
+    if (position == -1) {
+        return;
+    }
+    checkpointStream stream = {position, 0, 0};
+    writeCheckpoint(stream);
+    // The checksum comes last, so a partly written checkpoint is not used
+    byte check = stream.check;
+    checkpointPut(stream, &check, 1);
+    commitVersion(CHECKPOINT_FILE);
+    Serial.print(F("Checkpoint saved, processes: "));
+    Serial.println(noOfProc);
+}
+// Resume the processes of the checkpoint, function returns whether it was
+// valid and not empty
+bool restoreCheckpoint() {
+    int fatIndex = getFileInFAT(CHECKPOINT_FILE);
+    if (fatIndex == -1) {
+        return false;
+    }
+    FATEntry file = getFile(fatIndex);
+    checkpointStream stream = {file.beginPosition, 0, 0};
+    byte data[STACKSIZE];
+    while (stream.size < file.length - 1) {
+        checkpointGet(stream, data, 1);
+    }
+    if (file.length < 7 || stream.check != storage.read(file.beginPosition + stream.size) ||
+        storage.read(file.beginPosition) != CHECKPOINT_MAGIC) {
+        Serial.println(F("Error. Invalid checkpoint."));
+        return false;
+    }
+    stream = {file.beginPosition, 1, 0};
+    byte count;
+    uint32_t now;
+    checkpointGet(stream, &count, 1);
+    checkpointGet(stream, &now, sizeof(now));
+    if (count == 0) {
+        return false;
+    }
+    // Continue the program time where the checkpoint left it
+    clockOffset = now - millis();
+    for (int n = 0; n < count; n++) {
+        char name[MAX_FILE_NAME_LENGTH];
+        int16_t length, pc;
+        uint16_t check;
+        byte priority, flags, sp;
+        char state;
+        uint32_t release;
+        int32_t period;
+        byte macro[2];
+        checkpointGet(stream, name, sizeof(name));
+        checkpointGet(stream, &length, sizeof(length));
+        checkpointGet(stream, &check, sizeof(check));
+        checkpointGet(stream, &priority, 1);
+        checkpointGet(stream, &state, 1);
+        checkpointGet(stream, &flags, 1);
+        checkpointGet(stream, &release, sizeof(release));
+        checkpointGet(stream, &period, sizeof(period));
+        checkpointGet(stream, &pc, sizeof(pc));
+        checkpointGet(stream, macro, sizeof(macro));
+        checkpointGet(stream, &sp, 1);
+        checkpointGet(stream, data, sp);
+        // The program has to be the one the state belongs to
+        int programIndex = getFileInFAT(name);
+        int procID = -1;
+        if (programIndex != -1 && getFile(programIndex).length == length &&
+            fileCheck(getFile(programIndex)) == check) {
+            procID = runProcess(name, priority);
+        } else {
+            Serial.print(F("Error. Program has changed, not resumed: "));
+            Serial.println(name);
+        }
+        int index = (procID != -1) ? getPid(procID) : -1;
+        if (index != -1) {
+            process& proc = processTable[index];
+            proc.pc = pc;
+            proc.macroPos = macro[0];
+            proc.macroEnd = macro[1];
+            proc.sp = sp;
+            memcpy(stack[index], data, sp);
+            proc.sleeping = flags & 1;
+            proc.release = release;
+#if EDF_ENABLED
+            proc.periodic = flags >> 1 & 1;
+            proc.period = period;
+#endif
+            // Interrupts are not attached again, WAITEVENT runs again and finds none
+            if (state == 'e') {
+                state = 'r';
+            }
+            if (state != 'r') {
+                changeProcessState(index, state);
+            }
+        }
+        byte vars;
+        checkpointGet(stream, &vars, 1);
+        for (int j = 0; j < vars; j++) {
+            byte header[3];
+            checkpointGet(stream, header, sizeof(header));
+            checkpointGet(stream, data, header[2]);
+            if (index != -1 && noOfVars < MAX_VARIABLES) {
+                int address = allocateVariable(header[0], procID, header[1], header[2]);
+                memcpy(RAM + address, data, header[2]);
+            }
+        }
+    }
+    return true;
+}
+// Start the processes at boot: those of the checkpoint if there is one,
+// otherwise the autostart list
+void startProcesses() {
+    recoverVersion(AUTOSTART_FILE);
+    recoverVersion(CHECKPOINT_FILE);
+    if (restoreCheckpoint()) {
+        return;
+    }
+    autostartEntry list[MAX_AUTOSTART];
+    int count = readAutostart(list);
+    for (int i = 0; i < count; i++) {
+        runProcess(list[i].name, list[i].priority);
+    }
+}
+
+void setup() {
+#if WATCHDOG_ENABLED
+    // The watchdog stays enabled after it has reset the board
+    byte resetFlags = MCUSR;
+    MCUSR = 0;
+    wdt_disable();
+#endif
+    for (int i = 0; i < PROCESS_TABLE_SIZE; i++) {
+        processTable[i].state = '0';
+    }
+    for (int n = 0; n < NO_OF_EVENTS; n++) {
+        events[n].procID = -1;
+    }
+    Serial.begin(9600);
+#if SD_ENABLED
+    if (!card.init(SPI_HALF_SPEED, SD_CHIP_SELECT)) {
+        Serial.println(F("Error. No SD card found."));
+    }
+#endif
+    readFAT();
+    Serial.println(F("\nArduinOS 1.0 ready.\n"));
+#if WATCHDOG_ENABLED
+    if (resetFlags & _BV(WDRF)) {
+        Serial.println(F("Error. Reset by the watchdog."));
+    }
+    // Enabled after readFAT(), which may clear the whole EEPROM
+    wdt_enable(WATCHDOG_TIMEOUT);
+#endif
+    startProcesses();
+}
+
+void loop() {
+    feedWatchdog();
+    inputCLI();
+    runProcesses();
+}
+
+void store() {
+    // Store a file in the file system
+    storeFile(buffer[1], atoi(buffer[2]));
+}
+void retrieve() {
+    // Retrieve a file from the file system
+    retrieveFile(buffer[1]);
+}
+void erase() {
+    // Delete a file
+    eraseFile(buffer[1]);
+}
+void files() {
+    // Print a list of stored files
+    printFAT();
+}
+void freespace() {
+    // Print the available space in file system
+    freespaceEEPROM();
+}
+void run() {
+    // Start a program, optionally with a priority
+    if (argumentCounter == 1) {
+        runProcess(buffer[1], DEFAULT_PRIORITY);
+    } else if (isNumeric(2) && atoi(buffer[2]) >= MIN_PRIORITY && atoi(buffer[2]) <= MAX_PRIORITY) {
+        runProcess(buffer[1], atoi(buffer[2]));
+    } else {
+        Serial.println(F("Error. Priority must be between 1 and 10."));
+    }
+}
+void list() {
+    //show active status of running programs
+    showProcesses();
+}
+void suspend() {
+    // Suspend a process
+    if (isNumeric()) {
+        suspendProcess(atoi(buffer[1]));
+    } else {
+        Serial.println(F("Error. Invalid process ID."));
+    }
+}
+void resume() {
+    // Resume a process
+    if (isNumeric()) {
+        resumeProcess(atoi(buffer[1]));
+    } else {
+        Serial.println(F("Error. Invalid process ID."));
+    }
+}
+void kill() {
+    // Stop a process
+    if (isNumeric()) {
+        stopProcess(atoi(buffer[1]));
+    } else {
+        Serial.println(F("Error. Invalid process ID."));
+    }
+}
+void defrag() {
+    // Coalesce the free space in the file system
+    defragEEPROM();
+}
+void nice() {
+    // Change the priority of a process
+    if (isNumeric() && isNumeric(2)) {
+        setPriority(atoi(buffer[1]), atoi(buffer[2]));
+    } else {
+        Serial.println(F("Error. Invalid process ID or priority."));
+    }
+}
+#if EDF_ENABLED
+void sched() {
+    // Select or show the scheduling mode
+    if (argumentCounter == 1) {
+        if (strcmp(buffer[1], "stride") == 0) {
+            schedulingMode = STRIDE_MODE;
+        } else if (strcmp(buffer[1], "edf") == 0) {
+            schedulingMode = EDF_MODE;
+        } else {
+            Serial.println(F("Error. Scheduling mode must be stride or edf."));
+            return;
+        }
+    }
+    Serial.print(F("Scheduling mode: "));
+    Serial.println(schedulingMode == EDF_MODE ? F("edf") : F("stride"));
+}
+#endif
+void autostart() {
+    // Show the programs started at boot, add one or remove it with "off"
+    if (argumentCounter == 0) {
+        printAutostart();
+    } else if (argumentCounter == 1) {
+        setAutostart(buffer[1], DEFAULT_PRIORITY);
+    } else if (strcmp(buffer[2], "off") == 0) {
+        setAutostart(buffer[1], 0);
+    } else if (isNumeric(2) && atoi(buffer[2]) >= MIN_PRIORITY && atoi(buffer[2]) <= MAX_PRIORITY) {
+        setAutostart(buffer[1], atoi(buffer[2]));
+    } else {
+        Serial.println(F("Error. Priority must be between 1 and 10."));
+    }
+}
+void checkpoint() {
+    // Save the running processes for a warm restart, or remove the checkpoint with "off"
+    if (argumentCounter == 0) {
+        saveCheckpoint();
+    } else if (strcmp(buffer[1], "off") == 0) {
+        replaceFile(CHECKPOINT_FILE, 0, NULL);
+        Serial.println(F("Checkpoint removed."));
+    } else {
+        Serial.println(F("Error. Argument must be off."));
+    }
+}
+void budget() {
+    // Show the budget of new processes, set it, or set the budget of a process
+    if (argumentCounter == 2) {
+        if (isNumeric() && isNumeric(2) && atol(buffer[2]) <= UINT16_MAX) {
+            setBudget(atoi(buffer[1]), atol(buffer[2]));
+        } else {
+            Serial.println(F("Error. Invalid process ID or budget."));
+        }
+        return;
+    }
+    if (argumentCounter == 1) {
+        if (!isNumeric() || atol(buffer[1]) > UINT16_MAX) {
+            Serial.println(F("Error. Budget must be between 0 and 65535."));
+            return;
+        }
+        defaultBudget = atol(buffer[1]);
+    }
+    Serial.print(F("Budget of new processes: "));
+    Serial.println(defaultBudget);
+}
+#if DUMP_ENABLED
+void dump() {
+    // Print a file as bytecode instructions
+    dumpFile(buffer[1]);
+}
+#endif
+#if PROFILING_ENABLED
+void stats() {
+    // Print the opcode and process counters
+    printStats();
+}
+#endif
\ No newline at end of file